@@ -0,0 +1,78 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+// No include guard: this file is included once for every set of kernels.
+//
+// Usage:
+//
+//     #define VIGRA_FASTFILTERS_KERNELS <vigra2/my_kernels.hxx>
+//     #include <vigra2/fastfilters_backends.hxx>
+//
+// compiles the kernel templates in 'my_kernels.hxx' once for each backend
+// namespace (fastfilters_scalar, fastfilters_sse4, fastfilters_avx2,
+// fastfilters_avx512), where they see the respective 'Simd' wrapper from
+// fastfilters_simd.hxx. Must be included at namespace 'vigra' scope.
+
+#ifndef VIGRA_FASTFILTERS_KERNELS
+#error "fastfilters_backends.hxx: define VIGRA_FASTFILTERS_KERNELS before inclusion."
+#endif
+
+namespace fastfilters_scalar {
+#include VIGRA_FASTFILTERS_KERNELS
+} // namespace fastfilters_scalar
+
+#if defined(VIGRA_FASTFILTERS_X86)
+
+VIGRA_FASTFILTERS_TARGET_PUSH("sse4.1")
+namespace fastfilters_sse4 {
+#include VIGRA_FASTFILTERS_KERNELS
+} // namespace fastfilters_sse4
+VIGRA_FASTFILTERS_TARGET_POP
+
+VIGRA_FASTFILTERS_TARGET_PUSH("avx2,fma,f16c")
+namespace fastfilters_avx2 {
+#include VIGRA_FASTFILTERS_KERNELS
+} // namespace fastfilters_avx2
+VIGRA_FASTFILTERS_TARGET_POP
+
+VIGRA_FASTFILTERS_TARGET_PUSH("avx512f")
+namespace fastfilters_avx512 {
+#include VIGRA_FASTFILTERS_KERNELS
+} // namespace fastfilters_avx512
+VIGRA_FASTFILTERS_TARGET_POP
+
+#endif // VIGRA_FASTFILTERS_X86
+
+#undef VIGRA_FASTFILTERS_KERNELS
@@ -0,0 +1,491 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#pragma once
+
+#ifndef VIGRA2_FASTFILTERS_BANK_HXX
+#define VIGRA2_FASTFILTERS_BANK_HXX
+
+#include <vigra2/config.hxx>
+#include <vigra2/tinyarray.hxx>
+#include <vigra2/array_nd.hxx>
+#include <vigra2/fastfilters.hxx>
+#include <vigra2/fastfilters_parallel.hxx>
+#include <vigra2/fastfilters_gaussian.hxx>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace vigra {
+
+    // instantiate ConvolveLineBank for every SIMD backend
+#define VIGRA_FASTFILTERS_KERNELS <vigra2/fastfilters_bank_kernels.hxx>
+#include <vigra2/fastfilters_backends.hxx>
+
+namespace fastfilters_detail {
+
+    // call f.run<n>() for the runtime value n <= NK
+template <int NK>
+struct BankDispatch
+{
+    template <class FUNCTOR>
+    static void call(int n, FUNCTOR const & f)
+    {
+        if (n == NK)
+            f.template run<NK>();
+        else
+            BankDispatch<NK - 1>::call(n, f);
+    }
+};
+
+template <>
+struct BankDispatch<0>
+{
+    template <class FUNCTOR>
+    static void call(int, FUNCTOR const &)
+    {}
+};
+
+} // namespace fastfilters_detail
+
+/** \addtogroup Filters
+*/
+//@{
+
+    /** A set of 1D kernels applied to the same input in a single pass.
+
+        Where AvxConvolveLine streams the input through memory once per kernel,
+        the filter bank loads each input vector once and updates the
+        accumulators of all kernels from it (up to <tt>max_fused</tt> kernels
+        per pass, larger banks are processed in chunks). Even and odd kernels
+        of different radii can be mixed; shorter kernels are padded with zeros.
+
+        Usage:
+        \code
+        FilterBank bank;
+        bank.add(fastfilters_gaussian_kernel(2.0, 0, 6), KernelEven);
+        bank.add(fastfilters_gaussian_kernel(2.0, 1, 7), KernelOdd);
+        float * results[] = { smoothed, derivative };
+        bank.exec_x(in, size, results);
+        \endcode
+    */
+class FilterBank
+{
+  public:
+    static const int max_fused = 10;
+
+    FilterBank()
+    : radius_(0)
+    {}
+
+        /** Add the right half <tt>kernel[0..radius]</tt> of a symmetric or
+            antisymmetric kernel. Returns the index of the corresponding output.
+        */
+    int add(std::vector<float> const & kernel, KernelSymmetry symmetry)
+    {
+        if (kernel.empty())
+            throw std::runtime_error("FilterBank::add(): empty kernel.");
+        if (symmetry == KernelNotSymmetric)
+            throw std::runtime_error("FilterBank::add(): kernel must be symmetric or antisymmetric.");
+
+        kernels_.push_back(kernel);
+        symmetry_.push_back(symmetry);
+        radius_ = std::max(radius_, (ArrayIndex)kernel.size() - 1);
+        interleave();
+        return size() - 1;
+    }
+
+    int size() const
+    {
+        return (int)kernels_.size();
+    }
+
+    ArrayIndex radius() const
+    {
+        return radius_;
+    }
+
+        /** Filter a line of length <tt>size</tt>; result j is written to
+            <tt>out[j][0..size-1]</tt>. The outputs must not alias the input.
+        */
+    void exec_x(float * in, ArrayIndex size, float * const * out) const
+    {
+        for (int c = 0; c < (int)kernels_.size(); c += max_fused)
+        {
+            ExecX f = { in, size, out + c, &interleaved_[c * (radius_ + 1)], odd_mask(c), radius_ };
+            dispatch(chunk_size(c), f);
+        }
+    }
+
+        /** Filter a 2D plane along y; result j is written to <tt>out[j]</tt>
+            with <tt>out_stride</tt>. The outputs must not alias the input.
+        */
+    void exec_y(float * in, ArrayIndex width, ArrayIndex height, ArrayIndex in_stride,
+                float * const * out, ArrayIndex out_stride) const
+    {
+        exec_y_rows(in, width, height, in_stride, out, out_stride, 0, height);
+    }
+
+        /** Compute output rows [y_begin, y_end) of exec_y(). Row y of result j
+            is written to <tt>out[j] + y*out_stride</tt>.
+        */
+    void exec_y_rows(float * in, ArrayIndex width, ArrayIndex height, ArrayIndex in_stride,
+                     float * const * out, ArrayIndex out_stride,
+                     ArrayIndex y_begin, ArrayIndex y_end) const
+    {
+        for (int c = 0; c < size(); c += max_fused)
+        {
+            ExecY f = { in, width, height, in_stride, out + c, out_stride,
+                        &interleaved_[c * (radius_ + 1)], odd_mask(c), radius_, y_begin, y_end };
+            dispatch(chunk_size(c), f);
+        }
+    }
+
+  private:
+    struct ExecX
+    {
+        float * in;
+        ArrayIndex size;
+        float * const * out;
+        float const * kernels;
+        unsigned odd;
+        ArrayIndex radius;
+
+        template <int NK>
+        void run() const
+        {
+            VIGRA_FASTFILTERS_DISPATCH(ConvolveLineBank<NK>::exec_x(in, size, out, kernels, odd, radius))
+        }
+    };
+
+    struct ExecY
+    {
+        float * in;
+        ArrayIndex width, height, in_stride;
+        float * const * out;
+        ArrayIndex out_stride;
+        float const * kernels;
+        unsigned odd;
+        ArrayIndex radius, y_begin, y_end;
+
+        template <int NK>
+        void run() const
+        {
+            VIGRA_FASTFILTERS_DISPATCH(ConvolveLineBank<NK>::exec_y_rows(in, width, height, in_stride,
+                                                                         out, out_stride, kernels, odd, radius,
+                                                                         y_begin, y_end))
+        }
+    };
+
+    template <class FUNCTOR>
+    static void dispatch(int n, FUNCTOR const & f)
+    {
+        fastfilters_detail::BankDispatch<max_fused>::call(n, f);
+    }
+
+    int chunk_size(int c) const
+    {
+        return size() - c < max_fused ? size() - c : max_fused;
+    }
+
+    unsigned odd_mask(int c) const
+    {
+        unsigned odd = 0;
+        for (int j = 0; j < chunk_size(c); ++j)
+            if (symmetry_[c + j] == KernelOdd)
+                odd |= 1u << j;
+        return odd;
+    }
+
+        // Store the coefficients of each chunk such that tap k of kernel j
+        // is at chunk_begin + k*chunk_size + j.
+    void interleave()
+    {
+        interleaved_.assign(size() * (radius_ + 1), 0.0f);
+        for (int c = 0; c < size(); c += max_fused)
+        {
+            float * chunk = &interleaved_[c * (radius_ + 1)];
+            for (int j = 0; j < chunk_size(c); ++j)
+                for (std::size_t k = 0; k < kernels_[c + j].size(); ++k)
+                    chunk[k * chunk_size(c) + j] = kernels_[c + j][k];
+        }
+    }
+
+    std::vector<std::vector<float>> kernels_;
+    std::vector<KernelSymmetry> symmetry_;
+    std::vector<float> interleaved_;
+    ArrayIndex radius_;
+};
+
+namespace fastfilters_detail {
+
+    /* Compute the 2D Gaussian derivatives with orders (order_x, order_y) of
+       'src' row by row and pass each finished row to combine(y, responses),
+       where responses[i] points to row y of the response to orders[i].
+
+       The y-pass applies one filter bank with all distinct y-orders, the
+       x-pass one bank per y-order with all x-orders paired with it. Only single
+       rows of the intermediate results are stored, so that nothing but the
+       combined features is ever written to main memory.
+    */
+template <class COMBINE>
+void gaussian_derivatives_2d(ArrayViewND<2, float> const & src, double sigma,
+                             std::vector<TinyArray<int, 2>> const & orders,
+                             WorkStealingThreadPool & pool, COMBINE combine)
+{
+    const ArrayIndex width = src.shape()[0], height = src.shape()[1];
+    if (src.strides()[0] != 1)
+        throw std::runtime_error("gaussian_derivatives_2d(): rows must be consecutive.");
+    if (width == 0 || height == 0)
+        return;
+
+    // y-bank with the distinct y-orders, one x-bank per y-order
+    FilterBank ybank;
+    std::vector<int> y_orders;
+    std::vector<FilterBank> xbanks;
+    std::vector<std::vector<int>> outputs; // result indices of x-bank g
+
+    for (std::size_t i = 0; i < orders.size(); ++i)
+    {
+        const int ox = orders[i][0], oy = orders[i][1];
+        int g = (int)(std::find(y_orders.begin(), y_orders.end(), oy) - y_orders.begin());
+        if (g == (int)y_orders.size())
+        {
+            y_orders.push_back(oy);
+            ybank.add(fastfilters_gaussian_kernel(sigma, oy, fastfilters_gaussian_radius(sigma, oy)),
+                      oy % 2 ? KernelOdd : KernelEven);
+            xbanks.push_back(FilterBank());
+            outputs.push_back(std::vector<int>());
+        }
+        xbanks[g].add(fastfilters_gaussian_kernel(sigma, ox, fastfilters_gaussian_radius(sigma, ox)),
+                      ox % 2 ? KernelOdd : KernelEven);
+        outputs[g].push_back((int)i);
+    }
+
+    if (ybank.radius() >= height)
+        throw std::runtime_error("gaussian_derivatives_2d(): kernel longer than image height.");
+    for (auto const & bank : xbanks)
+        if (bank.radius() >= width)
+            throw std::runtime_error("gaussian_derivatives_2d(): kernel longer than image width.");
+
+    float * in = const_cast<float *>(src.data());
+    const ArrayIndex in_stride = src.strides()[1];
+    const ArrayIndex n_tasks = std::min<ArrayIndex>(height, 4 * pool.size()),
+                     strip = (height + n_tasks - 1) / n_tasks;
+
+    pool.parallel_for(n_tasks, [&](ArrayIndex task)
+    {
+        // per-task row buffers
+        std::vector<float> yrows(y_orders.size() * width), responses(orders.size() * width);
+        std::vector<float *> yptr(y_orders.size()), rptr(orders.size()), xout;
+        for (std::size_t g = 0; g < y_orders.size(); ++g)
+            yptr[g] = &yrows[g * width];
+        for (std::size_t i = 0; i < orders.size(); ++i)
+            rptr[i] = &responses[i * width];
+
+        const ArrayIndex y_end = std::min(height, (task + 1) * strip);
+        for (ArrayIndex y = task * strip; y < y_end; ++y)
+        {
+            // out_stride 0: row y goes to the start of the row buffers
+            ybank.exec_y_rows(in, width, height, in_stride, &yptr[0], 0, y, y + 1);
+
+            for (std::size_t g = 0; g < y_orders.size(); ++g)
+            {
+                xout.clear();
+                for (int i : outputs[g])
+                    xout.push_back(rptr[i]);
+                xbanks[g].exec_x(yptr[g], width, &xout[0]);
+            }
+
+            combine(y, (float const * const *)&rptr[0]);
+        }
+    });
+}
+
+inline void check_feature_shape(ArrayViewND<2, float> const & src, ArrayViewND<2, float> const & dest)
+{
+    if (!(src.shape() == dest.shape()) || dest.strides()[0] != 1)
+        throw std::runtime_error("fastfilters: destination must have the source's shape and consecutive rows.");
+}
+
+} // namespace fastfilters_detail
+
+    /** Compute several Gaussian derivatives of a 2D image in one pass.
+
+        <tt>orders[i] = (order_x, order_y)</tt> specifies the derivative written
+        to <tt>dest[i]</tt>. Each input row is read once for all derivatives,
+        see FilterBank. Rows (axis 0) must be consecutive in memory.
+    */
+inline void
+fastfilters_gaussian_derivatives(ArrayViewND<2, float> const & src, std::vector<ArrayViewND<2, float>> const & dest,
+                                 std::vector<TinyArray<int, 2>> const & orders, double sigma,
+                                 WorkStealingThreadPool & pool)
+{
+    if (dest.size() != orders.size())
+        throw std::runtime_error("fastfilters_gaussian_derivatives(): need one destination per derivative.");
+    for (auto const & d : dest)
+        fastfilters_detail::check_feature_shape(src, d);
+
+    const ArrayIndex width = src.shape()[0];
+    fastfilters_detail::gaussian_derivatives_2d(src, sigma, orders, pool,
+        [&](ArrayIndex y, float const * const * responses)
+        {
+            for (std::size_t i = 0; i < dest.size(); ++i)
+                std::copy(responses[i], responses[i] + width, dest[i].data() + y * dest[i].strides()[1]);
+        });
+}
+
+inline void
+fastfilters_gaussian_derivatives(ArrayViewND<2, float> const & src, std::vector<ArrayViewND<2, float>> const & dest,
+                                 std::vector<TinyArray<int, 2>> const & orders, double sigma)
+{
+    WorkStealingThreadPool serial(1);
+    fastfilters_gaussian_derivatives(src, dest, orders, sigma, serial);
+}
+
+    /** Magnitude of the Gaussian gradient of a 2D image at scale <tt>sigma</tt>.
+    */
+inline void
+fastfilters_gradient_magnitude(ArrayViewND<2, float> const & src, ArrayViewND<2, float> dest,
+                               double sigma, WorkStealingThreadPool & pool)
+{
+    fastfilters_detail::check_feature_shape(src, dest);
+
+    std::vector<TinyArray<int, 2>> orders = { TinyArray<int, 2>{ 1, 0 }, TinyArray<int, 2>{ 0, 1 } };
+    const ArrayIndex width = src.shape()[0];
+    fastfilters_detail::gaussian_derivatives_2d(src, sigma, orders, pool,
+        [&](ArrayIndex y, float const * const * r)
+        {
+            float * d = dest.data() + y * dest.strides()[1];
+            for (ArrayIndex x = 0; x < width; ++x)
+                d[x] = std::sqrt(r[0][x] * r[0][x] + r[1][x] * r[1][x]);
+        });
+}
+
+inline void
+fastfilters_gradient_magnitude(ArrayViewND<2, float> const & src, ArrayViewND<2, float> dest, double sigma)
+{
+    WorkStealingThreadPool serial(1);
+    fastfilters_gradient_magnitude(src, dest, sigma, serial);
+}
+
+    /** Eigenvalues of the Hessian matrix of a 2D image at scale <tt>sigma</tt>,
+        larger eigenvalue in <tt>ev_large</tt>, smaller in <tt>ev_small</tt>.
+        The second derivatives are never stored.
+    */
+inline void
+fastfilters_hessian_eigenvalues(ArrayViewND<2, float> const & src,
+                                ArrayViewND<2, float> ev_large, ArrayViewND<2, float> ev_small,
+                                double sigma, WorkStealingThreadPool & pool)
+{
+    fastfilters_detail::check_feature_shape(src, ev_large);
+    fastfilters_detail::check_feature_shape(src, ev_small);
+
+    std::vector<TinyArray<int, 2>> orders = { TinyArray<int, 2>{ 2, 0 }, TinyArray<int, 2>{ 1, 1 },
+                                              TinyArray<int, 2>{ 0, 2 } };
+    const ArrayIndex width = src.shape()[0];
+    fastfilters_detail::gaussian_derivatives_2d(src, sigma, orders, pool,
+        [&](ArrayIndex y, float const * const * r)
+        {
+            float * large = ev_large.data() + y * ev_large.strides()[1],
+                  * small = ev_small.data() + y * ev_small.strides()[1];
+            for (ArrayIndex x = 0; x < width; ++x)
+            {
+                float mean = 0.5f * (r[0][x] + r[2][x]),
+                      diff = 0.5f * (r[0][x] - r[2][x]),
+                      root = std::sqrt(diff * diff + r[1][x] * r[1][x]);
+                large[x] = mean + root;
+                small[x] = mean - root;
+            }
+        });
+}
+
+inline void
+fastfilters_hessian_eigenvalues(ArrayViewND<2, float> const & src,
+                                ArrayViewND<2, float> ev_large, ArrayViewND<2, float> ev_small, double sigma)
+{
+    WorkStealingThreadPool serial(1);
+    fastfilters_hessian_eigenvalues(src, ev_large, ev_small, sigma, serial);
+}
+
+    /** Structure tensor of a 2D image: the gradient at <tt>inner_sigma</tt> is
+        computed in one pass and only its products are written to the outputs,
+        which are then smoothed in-place at <tt>outer_sigma</tt>.
+    */
+inline void
+fastfilters_structure_tensor(ArrayViewND<2, float> const & src,
+                             ArrayViewND<2, float> txx, ArrayViewND<2, float> txy, ArrayViewND<2, float> tyy,
+                             double inner_sigma, double outer_sigma, WorkStealingThreadPool & pool)
+{
+    fastfilters_detail::check_feature_shape(src, txx);
+    fastfilters_detail::check_feature_shape(src, txy);
+    fastfilters_detail::check_feature_shape(src, tyy);
+
+    std::vector<TinyArray<int, 2>> orders = { TinyArray<int, 2>{ 1, 0 }, TinyArray<int, 2>{ 0, 1 } };
+    const ArrayIndex width = src.shape()[0];
+    fastfilters_detail::gaussian_derivatives_2d(src, inner_sigma, orders, pool,
+        [&](ArrayIndex y, float const * const * r)
+        {
+            float * xx = txx.data() + y * txx.strides()[1],
+                  * xy = txy.data() + y * txy.strides()[1],
+                  * yy = tyy.data() + y * tyy.strides()[1];
+            for (ArrayIndex x = 0; x < width; ++x)
+            {
+                xx[x] = r[0][x] * r[0][x];
+                xy[x] = r[0][x] * r[1][x];
+                yy[x] = r[1][x] * r[1][x];
+            }
+        });
+
+    fastfilters_gaussian(txx, txx, TinyArray<double, 2>(outer_sigma), TinyArray<int, 2>(0), pool);
+    fastfilters_gaussian(txy, txy, TinyArray<double, 2>(outer_sigma), TinyArray<int, 2>(0), pool);
+    fastfilters_gaussian(tyy, tyy, TinyArray<double, 2>(outer_sigma), TinyArray<int, 2>(0), pool);
+}
+
+inline void
+fastfilters_structure_tensor(ArrayViewND<2, float> const & src,
+                             ArrayViewND<2, float> txx, ArrayViewND<2, float> txy, ArrayViewND<2, float> tyy,
+                             double inner_sigma, double outer_sigma)
+{
+    WorkStealingThreadPool serial(1);
+    fastfilters_structure_tensor(src, txx, txy, tyy, inner_sigma, outer_sigma, serial);
+}
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA2_FASTFILTERS_BANK_HXX
@@ -0,0 +1,168 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+// No include guard: this file is compiled once per SIMD backend via
+// fastfilters_backends.hxx and relies on the backend's 'Simd' wrapper.
+
+    // Apply NK kernels of common radius at once. Each input vector is loaded
+    // once per tap, the sum and difference of the pixel pair are formed once,
+    // and all NK accumulators are updated from these shared values.
+    //
+    // 'kernels' holds the interleaved coefficients: kernels[k*NK + j] is tap k
+    // of kernel j. Bit j of 'odd' is set if kernel j is antisymmetric.
+    // The outputs must not alias the input.
+template <int NK>
+struct ConvolveLineBank
+{
+    typedef Simd::vector vector;
+
+    static const ArrayIndex N = Simd::size;
+
+    static vector select(unsigned odd, int j, vector sum, vector diff)
+    {
+        return (odd >> j) & 1 ? diff : sum;
+    }
+
+        // one pixel of exec_x() with reflective border treatment
+    static void pixel_x(float * in, ArrayIndex size, ArrayIndex x, float * const * out,
+                        float const * kernels, unsigned odd, ArrayIndex radius)
+    {
+        float acc[NK];
+        for (int j = 0; j < NK; ++j)
+            acc[j] = kernels[j] * in[x];
+
+        for (ArrayIndex k = 1; k <= radius; ++k)
+        {
+            float left  = in[x < k ? k - x : x - k],
+                  right = in[likely(x + k < size) ? x + k : size - ((k + x) % size) - 2];
+            float sum = right + left, diff = right - left;
+            for (int j = 0; j < NK; ++j)
+                acc[j] += kernels[k*NK + j] * ((odd >> j) & 1 ? diff : sum);
+        }
+
+        for (int j = 0; j < NK; ++j)
+            out[j][x] = acc[j];
+    }
+
+    static void exec_x(float * in, ArrayIndex size, float * const * out,
+                       float const * kernels, unsigned odd, ArrayIndex radius)
+    {
+        // left border
+        ArrayIndex x = 0;
+        for (; x < radius && x < size; ++x)
+            pixel_x(in, size, x, out, kernels, odd, radius);
+
+        // valid part of line
+        for (; x + N <= size - radius; x += N)
+        {
+            vector acc[NK];
+            vector pixels = Simd::load(in + x);
+            for (int j = 0; j < NK; ++j)
+                acc[j] = Simd::mul(pixels, Simd::broadcast(kernels + j));
+
+            for (ArrayIndex k = 1; k <= radius; ++k)
+            {
+                vector left  = Simd::load(in + (x - k)),
+                       right = Simd::load(in + x + k);
+                vector sum  = Simd::add(right, left),
+                       diff = Simd::sub(right, left);
+                for (int j = 0; j < NK; ++j)
+                    acc[j] = Simd::fmadd(select(odd, j, sum, diff), Simd::broadcast(kernels + k*NK + j), acc[j]);
+            }
+
+            for (int j = 0; j < NK; ++j)
+                Simd::store(out[j] + x, acc[j]);
+        }
+
+        // remaining pixels and right border
+        for (; x < size; ++x)
+            pixel_x(in, size, x, out, kernels, odd, radius);
+    }
+
+        // Compute output rows [y_begin, y_end) of the y-convolution; row y
+        // of result j is written to out[j] + y*out_stride.
+    static void exec_y_rows(float * in, ArrayIndex width, ArrayIndex height, ArrayIndex in_stride,
+                            float * const * out, ArrayIndex out_stride,
+                            float const * kernels, unsigned odd, ArrayIndex radius,
+                            ArrayIndex y_begin, ArrayIndex y_end)
+    {
+        const ArrayIndex simd_end = width - width % N;
+        const Simd::mask mask = Simd::tail_mask(width - simd_end);
+
+        for (ArrayIndex y = y_begin; y < y_end; ++y)
+        {
+            const float * cur_inptr = in + y * in_stride;
+            const bool border = y < radius || y >= height - radius;
+
+            for (ArrayIndex x = 0; x < width; x += N)
+            {
+                const bool tail = x >= simd_end;
+
+                vector acc[NK];
+                vector pixels = tail ? Simd::load_masked(cur_inptr + x, mask)
+                                     : Simd::load(cur_inptr + x);
+                for (int j = 0; j < NK; ++j)
+                    acc[j] = Simd::mul(pixels, Simd::broadcast(kernels + j));
+
+                for (ArrayIndex k = 1; k <= radius; ++k)
+                {
+                    const float * row_left  = border && k > y
+                                                  ? in + (k - y) * in_stride
+                                                  : in + (y - k) * in_stride,
+                                * row_right = border && y + k >= height
+                                                  ? in + (height - ((k + y) % height) - 2) * in_stride
+                                                  : in + (y + k) * in_stride;
+
+                    vector left  = tail ? Simd::load_masked(row_left + x, mask)
+                                        : Simd::load(row_left + x),
+                           right = tail ? Simd::load_masked(row_right + x, mask)
+                                        : Simd::load(row_right + x);
+                    vector sum  = Simd::add(right, left),
+                           diff = Simd::sub(right, left);
+                    for (int j = 0; j < NK; ++j)
+                        acc[j] = Simd::fmadd(select(odd, j, sum, diff), Simd::broadcast(kernels + k*NK + j), acc[j]);
+                }
+
+                for (int j = 0; j < NK; ++j)
+                {
+                    if (tail)
+                        Simd::store_masked(out[j] + y * out_stride + x, acc[j], mask);
+                    else
+                        Simd::store(out[j] + y * out_stride + x, acc[j]);
+                }
+            }
+        }
+    }
+};
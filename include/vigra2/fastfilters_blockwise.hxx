@@ -0,0 +1,678 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#pragma once
+
+#ifndef VIGRA2_FASTFILTERS_BLOCKWISE_HXX
+#define VIGRA2_FASTFILTERS_BLOCKWISE_HXX
+
+#include <vigra2/config.hxx>
+#include <vigra2/tinyarray.hxx>
+#include <vigra2/fastfilters.hxx>
+#include <vigra2/fastfilters_parallel.hxx>
+#include <vigra2/fastfilters_gaussian.hxx>
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vigra {
+
+/** \addtogroup Filters
+*/
+//@{
+
+    /** A file mapped into memory in its entirety.
+
+        The pages are loaded by the operating system on first access and
+        written back when the mapping is destroyed (or flush() is called),
+        so that files much larger than the physical memory can be processed.
+        \code
+        FastFiltersMappedFile in  = FastFiltersMappedFile::open("volume.raw"),
+                              out = FastFiltersMappedFile::create("result.raw", in.size());
+        \endcode
+    */
+class FastFiltersMappedFile
+{
+  public:
+        /** Map an existing file, read-only unless <tt>writable</tt> is true.
+        */
+    static FastFiltersMappedFile open(std::string const & path, bool writable = false)
+    {
+        FastFiltersMappedFile file;
+        file.map(path, writable, false, 0);
+        return file;
+    }
+
+        /** Create a file of <tt>size</tt> bytes (or resize an existing one)
+            and map it for reading and writing.
+        */
+    static FastFiltersMappedFile create(std::string const & path, std::size_t size)
+    {
+        FastFiltersMappedFile file;
+        file.map(path, true, true, size);
+        return file;
+    }
+
+    FastFiltersMappedFile(FastFiltersMappedFile && other)
+    : FastFiltersMappedFile()
+    {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+#ifdef _WIN32
+        std::swap(file_, other.file_);
+        std::swap(mapping_, other.mapping_);
+#endif
+    }
+
+    ~FastFiltersMappedFile()
+    {
+        close();
+    }
+
+    FastFiltersMappedFile(FastFiltersMappedFile const &) = delete;
+    FastFiltersMappedFile & operator=(FastFiltersMappedFile const &) = delete;
+
+    char * data() const
+    {
+        return data_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+        /** Write modified pages back to the file.
+        */
+    void flush()
+    {
+        if (data_ == 0)
+            return;
+#ifdef _WIN32
+        FlushViewOfFile(data_, 0);
+#else
+        msync(data_, size_, MS_SYNC);
+#endif
+    }
+
+  private:
+    FastFiltersMappedFile()
+    : data_(0)
+    , size_(0)
+    {
+#ifdef _WIN32
+        file_ = INVALID_HANDLE_VALUE;
+        mapping_ = 0;
+#endif
+    }
+
+#ifdef _WIN32
+    void map(std::string const & path, bool writable, bool create, std::size_t size)
+    {
+        file_ = CreateFileA(path.c_str(), writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                            FILE_SHARE_READ, 0, create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        mapping_ = 0;
+        if (file_ == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("FastFiltersMappedFile: cannot open '" + path + "'.");
+
+        LARGE_INTEGER length;
+        length.QuadPart = (LONGLONG)size;
+        if (create ? !SetFilePointerEx(file_, length, 0, FILE_BEGIN) || !SetEndOfFile(file_)
+                   : !GetFileSizeEx(file_, &length))
+        {
+            close();
+            throw std::runtime_error("FastFiltersMappedFile: cannot resize '" + path + "'.");
+        }
+        size_ = (std::size_t)length.QuadPart;
+        if (size_ == 0)
+            return;
+
+        mapping_ = CreateFileMappingA(file_, 0, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, 0);
+        if (mapping_ != 0)
+            data_ = (char *)MapViewOfFile(mapping_, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size_);
+        if (data_ == 0)
+        {
+            close();
+            throw std::runtime_error("FastFiltersMappedFile: cannot map '" + path + "'.");
+        }
+    }
+
+    void close()
+    {
+        if (data_ != 0)
+            UnmapViewOfFile(data_);
+        if (mapping_ != 0)
+            CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE)
+            CloseHandle(file_);
+        data_ = 0;
+        mapping_ = 0;
+        file_ = INVALID_HANDLE_VALUE;
+    }
+
+    HANDLE file_, mapping_;
+#else
+    void map(std::string const & path, bool writable, bool create, std::size_t size)
+    {
+        int fd = ::open(path.c_str(), writable ? (create ? O_RDWR | O_CREAT : O_RDWR) : O_RDONLY, 0644);
+        if (fd < 0)
+            throw std::runtime_error("FastFiltersMappedFile: cannot open '" + path + "'.");
+
+        struct stat info;
+        if (create ? ftruncate(fd, (off_t)size) != 0 : fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("FastFiltersMappedFile: cannot resize '" + path + "'.");
+        }
+        size_ = create ? size : (std::size_t)info.st_size;
+
+        // the mapping keeps the file open
+        void * data = size_ > 0 ? mmap(0, size_, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                                       MAP_SHARED, fd, 0)
+                                : 0;
+        ::close(fd);
+        if (data == MAP_FAILED)
+            throw std::runtime_error("FastFiltersMappedFile: cannot map '" + path + "'.");
+        data_ = (char *)data;
+    }
+
+    void close()
+    {
+        if (data_ != 0)
+            munmap(data_, size_);
+        data_ = 0;
+    }
+#endif
+
+    char * data_;
+    std::size_t size_;
+};
+
+    /** Half-open box <tt>[begin, end)</tt> of an N-D volume.
+    */
+template <int N>
+struct FastFiltersBox
+{
+    Shape<N> begin, end;
+
+    bool intersects(FastFiltersBox const & other) const
+    {
+        for (int k = 0; k < N; ++k)
+            if (begin[k] >= other.end[k] || other.begin[k] >= end[k])
+                return false;
+        return true;
+    }
+};
+
+    /** View of an N-D volume with pixel type <tt>T</tt> in external memory,
+        usually a FastFiltersMappedFile.
+
+        The volume is divided into chunks of <tt>chunk_shape</tt>, which are
+        stored one after the other with axis 0 varying fastest, and so are the
+        pixels within a chunk. The chunks at the upper borders are padded to
+        the full chunk size. A raw volume is a single chunk of the volume's shape.
+
+        The pixel types are those of AvxConvolveLine. read() and write() convert
+        between the volume and float buffers, see FastFiltersConvert.
+    */
+template <int N, class T>
+class FastFiltersVolume
+{
+  public:
+        /** Raw volume.
+        */
+    FastFiltersVolume(void * data, Shape<N> const & shape)
+    : FastFiltersVolume(data, shape, shape)
+    {}
+
+        /** Chunked volume.
+        */
+    FastFiltersVolume(void * data, Shape<N> const & shape, Shape<N> const & chunk_shape)
+    : data_((T *)data)
+    , shape_(shape)
+    , chunk_shape_(chunk_shape)
+    , chunk_size_(1)
+    {
+        ArrayIndex n_chunks = 1;
+        for (int k = 0; k < N; ++k)
+        {
+            if (shape[k] < 0 || chunk_shape[k] <= 0)
+                throw std::runtime_error("FastFiltersVolume(): invalid shape or chunk shape.");
+            chunk_strides_[k] = chunk_size_;
+            chunk_size_ *= chunk_shape[k];
+            grid_strides_[k] = n_chunks;
+            n_chunks *= (shape[k] + chunk_shape[k] - 1) / chunk_shape[k];
+        }
+        for (int k = 0; k < N; ++k)
+            grid_strides_[k] *= chunk_size_;
+    }
+
+        /** Number of bytes occupied by a volume of the given shape.
+        */
+    static std::size_t bytes(Shape<N> const & shape, Shape<N> const & chunk_shape)
+    {
+        std::size_t size = sizeof(T);
+        for (int k = 0; k < N; ++k)
+            size *= (std::size_t)((shape[k] + chunk_shape[k] - 1) / chunk_shape[k] * chunk_shape[k]);
+        return size;
+    }
+
+    static std::size_t bytes(Shape<N> const & shape)
+    {
+        return bytes(shape, shape);
+    }
+
+    T * data() const
+    {
+        return data_;
+    }
+
+    Shape<N> const & shape() const
+    {
+        return shape_;
+    }
+
+    Shape<N> const & chunk_shape() const
+    {
+        return chunk_shape_;
+    }
+
+        /** Address of the pixel at <tt>p</tt>.
+        */
+    T * pointer(Shape<N> const & p) const
+    {
+        ArrayIndex offset = 0;
+        for (int k = 0; k < N; ++k)
+            offset += p[k] / chunk_shape_[k] * grid_strides_[k] + p[k] % chunk_shape_[k] * chunk_strides_[k];
+        return data_ + offset;
+    }
+
+        /** Copy the pixels in <tt>box</tt> to <tt>buffer</tt>, which has the
+            given strides (<tt>strides[0]</tt> must be 1) and whose first
+            element corresponds to <tt>box.begin</tt>.
+        */
+    void read(FastFiltersBox<N> const & box, float * buffer, Shape<N> const & strides) const
+    {
+        for_each_run(box, buffer, strides, [](T const * v, float * b, ArrayIndex n)
+        {
+            for (ArrayIndex k = 0; k < n; ++k)
+                b[k] = FastFiltersConvert<T>::to_float(v[k]);
+        });
+    }
+
+        /** Copy <tt>buffer</tt> (as in read()) to the pixels in <tt>box</tt>.
+        */
+    void write(FastFiltersBox<N> const & box, float const * buffer, Shape<N> const & strides) const
+    {
+        for_each_run(box, buffer, strides, [](T * v, float const * b, ArrayIndex n)
+        {
+            for (ArrayIndex k = 0; k < n; ++k)
+                v[k] = FastFiltersConvert<T>::from_float(b[k]);
+        });
+    }
+
+  private:
+        // call f(volume, buffer, n) for every run of n pixels of 'box' which is
+        // consecutive in both, i.e. a row along axis 0 within one chunk
+    template <class BUFFER, class FUNCTOR>
+    void for_each_run(FastFiltersBox<N> const & box, BUFFER * buffer, Shape<N> const & strides,
+                      FUNCTOR f) const
+    {
+        for (int k = 0; k < N; ++k)
+            if (box.begin[k] >= box.end[k])
+                return;
+
+        Shape<N> p = box.begin;
+        while (true)
+        {
+            BUFFER * row = buffer;
+            for (int k = 1; k < N; ++k)
+                row += (p[k] - box.begin[k]) * strides[k];
+
+            for (ArrayIndex x = box.begin[0]; x < box.end[0];)
+            {
+                p[0] = x;
+                const ArrayIndex n = std::min(box.end[0], (x / chunk_shape_[0] + 1) * chunk_shape_[0]) - x;
+                f(pointer(p), row + (x - box.begin[0]), n);
+                x += n;
+            }
+
+            // next row
+            int k = 1;
+            for (; k < N; ++k)
+            {
+                if (++p[k] < box.end[k])
+                    break;
+                p[k] = box.begin[k];
+            }
+            if (k == N)
+                return;
+        }
+    }
+
+    T * data_;
+    Shape<N> shape_, chunk_shape_, chunk_strides_, grid_strides_;
+    ArrayIndex chunk_size_;
+};
+
+namespace fastfilters_detail {
+
+    // A persistent thread running one job at a time in the background: start()
+    // hands over the next job once wait() has collected the previous one. The
+    // destructor lets a running job finish.
+class PrefetchThread
+{
+  public:
+    PrefetchThread()
+    : busy_(false)
+    , stop_(false)
+    , thread_(&PrefetchThread::run, this)
+    {}
+
+    ~PrefetchThread()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        thread_.join();
+    }
+
+    PrefetchThread(PrefetchThread const &) = delete;
+    PrefetchThread & operator=(PrefetchThread const &) = delete;
+
+    void start(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = std::move(job);
+            busy_ = true;
+        }
+        wake_.notify_all();
+    }
+
+        // Wait until the current job has finished and rethrow its exception, if any.
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this]() { return !busy_; });
+        if (error_)
+        {
+            std::exception_ptr error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+  private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;)
+        {
+            wake_.wait(lock, [this]() { return stop_ || (bool)job_; });
+            if (stop_)
+                return;
+            std::function<void()> job = std::move(job_);
+            job_ = nullptr;
+            lock.unlock();
+            std::exception_ptr error;
+            try
+            {
+                job();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            lock.lock();
+            error_ = error;
+            busy_ = false;
+            wake_.notify_all();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::function<void()> job_;
+    std::exception_ptr error_;
+    bool busy_, stop_;
+    std::thread thread_;
+};
+
+    /* Filter the blocks of 'dest' for which 'selected(block)' is true. Every block
+       is read with a halo of one kernel radius into a float buffer, filtered there
+       by the same in-place passes as fastfilters_gaussian(), and the interior is
+       written to 'dest'. The next block is read by a PrefetchThread while the
+       pool filters the current one. Returns the number of filtered blocks.
+    */
+template <int N, class IN, class OUT, class SELECT>
+ArrayIndex gaussian_blocks(FastFiltersVolume<N, IN> const & src, FastFiltersVolume<N, OUT> const & dest,
+                           TinyArray<double, N> const & sigma, TinyArray<int, N> const & order,
+                           Shape<N> const & block_shape, WorkStealingThreadPool & pool,
+                           GaussianFilterOptions const & options, SELECT selected)
+{
+    if (!(src.shape() == dest.shape()))
+        throw std::runtime_error("fastfilters_gaussian_blockwise(): src and dest must have equal shape.");
+    if ((void const *)src.data() == (void const *)dest.data())
+        throw std::runtime_error("fastfilters_gaussian_blockwise(): cannot work in-place.");
+
+    Shape<N> const & shape = src.shape();
+    Shape<N> radius, n_blocks;
+    std::vector<std::vector<float>> kernels(N);
+    ArrayIndex total = 1, capacity = 1;
+    for (int k = 0; k < N; ++k)
+    {
+        if (block_shape[k] <= 0)
+            throw std::runtime_error("fastfilters_gaussian_blockwise(): block shape must be positive.");
+        if (shape[k] == 0)
+            return 0;
+        radius[k] = 0;
+        if (sigma[k] != 0.0 || order[k] != 0)
+        {
+            radius[k] = fastfilters_gaussian_radius(sigma[k], order[k], options.window_ratio);
+            if (radius[k] >= shape[k])
+                throw std::runtime_error("fastfilters_gaussian_blockwise(): kernel longer than volume axis.");
+            kernels[k] = fastfilters_gaussian_kernel(sigma[k], order[k], radius[k]);
+        }
+        n_blocks[k] = (shape[k] + block_shape[k] - 1) / block_shape[k];
+        total *= n_blocks[k];
+        capacity *= std::min(shape[k], block_shape[k] + 2 * radius[k]);
+    }
+
+    // the selected blocks in memory order of the volume
+    std::vector<FastFiltersBox<N>> blocks;
+    for (ArrayIndex i = 0; i < total; ++i)
+    {
+        FastFiltersBox<N> block;
+        ArrayIndex j = i;
+        for (int k = 0; k < N; ++k)
+        {
+            block.begin[k] = (j % n_blocks[k]) * block_shape[k];
+            block.end[k] = std::min(shape[k], block.begin[k] + block_shape[k]);
+            j /= n_blocks[k];
+        }
+        if (selected(block, radius))
+            blocks.push_back(block);
+    }
+
+    auto input_box = [&](FastFiltersBox<N> const & block, Shape<N> & box_shape, Shape<N> & strides)
+    {
+        FastFiltersBox<N> box;
+        ArrayIndex stride = 1;
+        for (int k = 0; k < N; ++k)
+        {
+            box.begin[k] = std::max<ArrayIndex>(0, block.begin[k] - radius[k]);
+            box.end[k] = std::min(shape[k], block.end[k] + radius[k]);
+            box_shape[k] = box.end[k] - box.begin[k];
+            strides[k] = stride;
+            stride *= box_shape[k];
+        }
+        return box;
+    };
+
+    std::vector<float> buffers[2] = { std::vector<float>(capacity), std::vector<float>(capacity) };
+    auto load = [&](std::size_t b)
+    {
+        Shape<N> box_shape, strides;
+        FastFiltersBox<N> box = input_box(blocks[b], box_shape, strides);
+        src.read(box, &buffers[b % 2][0], strides);
+    };
+
+    if (blocks.empty())
+        return 0;
+
+    // declared after the buffers, so that a pending read finishes before they are freed
+    PrefetchThread prefetch;
+    prefetch.start([&]() { load(0); });
+
+    for (std::size_t b = 0; b < blocks.size(); ++b)
+    {
+        prefetch.wait();
+        if (b + 1 < blocks.size())
+            prefetch.start([&, b]() { load(b + 1); });
+
+        float * buffer = &buffers[b % 2][0];
+        Shape<N> box_shape, strides;
+        FastFiltersBox<N> box = input_box(blocks[b], box_shape, strides);
+        ArrayIndex size = 1, offset = 0;
+        for (int k = 0; k < N; ++k)
+        {
+            size *= box_shape[k];
+            offset += (blocks[b].begin[k] - box.begin[k]) * strides[k];
+        }
+
+        for (int k = 0; k < N; ++k)
+        {
+            if (kernels[k].empty())
+                continue;
+            if (order[k] % 2 == 0)
+                convolve_axis<KernelEven>(pool, buffer, buffer, size, box_shape[k], strides[k],
+                                          &kernels[k][0], radius[k]);
+            else
+                convolve_axis<KernelOdd>(pool, buffer, buffer, size, box_shape[k], strides[k],
+                                         &kernels[k][0], radius[k]);
+        }
+
+        dest.write(blocks[b], buffer + offset, strides);
+    }
+    return (ArrayIndex)blocks.size();
+}
+
+} // namespace fastfilters_detail
+
+    /** Separable Gaussian smoothing / derivative filter of a volume that need
+        not fit into memory.
+
+        The parameters are as in fastfilters_gaussian(). <tt>dest</tt> is
+        computed block by block: each block of <tt>block_shape</tt> is read from
+        <tt>src</tt> together with a halo of one kernel radius on every side,
+        converted to float, filtered by the AvxConvolveLine passes, and its
+        interior is written to <tt>dest</tt>. Reading the next block overlaps
+        with filtering the current one. Memory use is bounded by two halo blocks,
+        independently of the size of the volume. src and dest must be distinct.
+
+        All axes are filtered with FIR kernels (the <tt>iir_threshold</tt> of
+        <tt>options</tt> is ignored), so that the result agrees with the
+        in-memory filter up to rounding. Choose blocks considerably larger than
+        the kernel radii to keep the halo overhead small.
+    */
+template <int N, class IN, class OUT>
+void fastfilters_gaussian_blockwise(FastFiltersVolume<N, IN> const & src, FastFiltersVolume<N, OUT> dest,
+                                    TinyArray<double, N> const & sigma, TinyArray<int, N> const & order,
+                                    Shape<N> const & block_shape, WorkStealingThreadPool & pool,
+                                    GaussianFilterOptions const & options = GaussianFilterOptions())
+{
+    fastfilters_detail::gaussian_blocks(src, dest, sigma, order, block_shape, pool, options,
+                                        [](FastFiltersBox<N> const &, Shape<N> const &) { return true; });
+}
+
+    /** Incremental version of the above: after the pixels of <tt>src</tt> in the
+        boxes <tt>changed</tt> have been modified, recompute only the blocks of
+        <tt>dest</tt> whose input (including the halo) intersects one of them.
+        <tt>block_shape</tt> need not be the same as in the original run.
+        Returns the number of recomputed blocks.
+    */
+template <int N, class IN, class OUT>
+ArrayIndex
+fastfilters_gaussian_blockwise_update(FastFiltersVolume<N, IN> const & src, FastFiltersVolume<N, OUT> dest,
+                                      TinyArray<double, N> const & sigma, TinyArray<int, N> const & order,
+                                      Shape<N> const & block_shape,
+                                      std::vector<FastFiltersBox<N>> const & changed,
+                                      WorkStealingThreadPool & pool,
+                                      GaussianFilterOptions const & options = GaussianFilterOptions())
+{
+    return fastfilters_detail::gaussian_blocks(src, dest, sigma, order, block_shape, pool, options,
+        [&](FastFiltersBox<N> const & block, Shape<N> const & radius)
+        {
+            FastFiltersBox<N> input = block;
+            for (int k = 0; k < N; ++k)
+            {
+                input.begin[k] -= radius[k];
+                input.end[k] += radius[k];
+            }
+            for (auto const & box : changed)
+                if (input.intersects(box))
+                    return true;
+            return false;
+        });
+}
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA2_FASTFILTERS_BLOCKWISE_HXX
@@ -0,0 +1,362 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#pragma once
+
+#ifndef VIGRA2_FASTFILTERS_GAUSSIAN_HXX
+#define VIGRA2_FASTFILTERS_GAUSSIAN_HXX
+
+#include <vigra2/config.hxx>
+#include <vigra2/tinyarray.hxx>
+#include <vigra2/array_nd.hxx>
+#include <vigra2/fastfilters.hxx>
+#include <vigra2/fastfilters_parallel.hxx>
+#include <vigra2/fastfilters_iir.hxx>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace vigra {
+
+/** \addtogroup Filters
+*/
+//@{
+
+    /** Radius of a sampled Gaussian (derivative) kernel, following the
+        convention <tt>radius = window_ratio * sigma + order / 2</tt>.
+    */
+inline ArrayIndex fastfilters_gaussian_radius(double sigma, int order, double window_ratio = 3.0)
+{
+    return (ArrayIndex)(window_ratio * sigma + 0.5 * order + 0.5);
+}
+
+    /** Sampled Gaussian or Gaussian derivative kernel of the given order (0, 1 or 2).
+
+        Returns the right half <tt>kernel[0..radius]</tt> in the form expected by
+        AvxConvolveLine: orders 0 and 2 are symmetric (use KernelEven), order 1 is
+        antisymmetric (use KernelOdd). The kernels are normalized to reproduce the
+        derivatives of polynomials exactly: smoothing preserves a constant,
+        the first derivative of <tt>x</tt> is 1 and the second derivative of
+        <tt>x*x</tt> is 2.
+    */
+inline std::vector<float>
+fastfilters_gaussian_kernel(double sigma, int order, ArrayIndex radius)
+{
+    if (sigma <= 0.0)
+        throw std::runtime_error("fastfilters_gaussian_kernel(): sigma must be positive.");
+    if (order < 0 || order > 2)
+        throw std::runtime_error("fastfilters_gaussian_kernel(): order must be 0, 1 or 2.");
+
+    double s2 = sigma * sigma;
+    std::vector<double> w(radius + 1);
+    for (ArrayIndex k = 0; k <= radius; ++k)
+    {
+        double g = std::exp(-0.5 * k * k / s2);
+        switch (order)
+        {
+        case 0:  w[k] = g; break;
+        case 1:  w[k] = k / s2 * g; break;
+        default: w[k] = (k * k / s2 - 1.0) / s2 * g;
+        }
+    }
+
+    if (order == 2)
+    {
+        // remove the DC component introduced by truncation
+        double dc = w[0];
+        for (ArrayIndex k = 1; k <= radius; ++k)
+            dc += 2.0 * w[k];
+        dc /= 2 * radius + 1;
+        for (ArrayIndex k = 0; k <= radius; ++k)
+            w[k] -= dc;
+    }
+
+    // normalize the moment of the given order over the full kernel
+    double norm = order == 0 ? w[0] : 0.0;
+    for (ArrayIndex k = 1; k <= radius; ++k)
+        norm += 2.0 * std::pow((double)k, order) * w[k];
+    norm = order == 2 ? 2.0 / norm : 1.0 / norm;
+
+    std::vector<float> kernel(radius + 1);
+    for (ArrayIndex k = 0; k <= radius; ++k)
+        kernel[k] = (float)(w[k] * norm);
+    return kernel;
+}
+
+    /** Options of fastfilters_gaussian().
+
+        <tt>window_ratio</tt>: radius of the FIR kernels in multiples of sigma
+        (default: 3).
+
+        <tt>iir_threshold</tt>: axes with sigma at or above this value are
+        filtered with the recursive AvxRecursiveGaussianLine instead of FIR
+        kernels (default: 8). Pass infinity to always use FIR kernels. The
+        recursive filter is never used below sigma = 0.5.
+    */
+struct GaussianFilterOptions
+{
+    GaussianFilterOptions()
+    : window_ratio(3.0)
+    , iir_threshold(8.0)
+    {}
+
+    GaussianFilterOptions & set_window_ratio(double ratio)
+    {
+        window_ratio = ratio;
+        return *this;
+    }
+
+    GaussianFilterOptions & set_iir_threshold(double threshold)
+    {
+        iir_threshold = threshold;
+        return *this;
+    }
+
+    bool use_iir(double sigma) const
+    {
+        return sigma >= std::max(0.5, iir_threshold);
+    }
+
+    double window_ratio, iir_threshold;
+};
+
+namespace fastfilters_detail {
+
+template <KernelSymmetry SYMMETRY, class IN>
+void convolve_axis(WorkStealingThreadPool & pool, IN const * in, float * out, ArrayIndex size,
+                   ArrayIndex axis_shape, ArrayIndex axis_stride,
+                   float * kernel, ArrayIndex radius)
+{
+    if (axis_stride == 1)
+    {
+        // innermost axis: filter consecutive lines
+        ParallelConvolveLine<SYMMETRY>::exec_x(pool, in, axis_shape, size / axis_shape, axis_shape,
+                                               out, axis_shape, kernel, radius);
+    }
+    else
+    {
+        // outer axis: all axes with smaller stride form a contiguous block
+        // of 'axis_stride' elements, which exec_y treats as a row of a 2D plane
+        const ArrayIndex plane = axis_shape * axis_stride;
+        ParallelConvolveLine<SYMMETRY>::exec_y(pool, in, axis_stride, axis_shape, axis_stride,
+                                               out, axis_stride, kernel, radius,
+                                               size / plane, plane, plane);
+    }
+}
+
+inline void recursive_axis(WorkStealingThreadPool & pool, float * in, float * out, ArrayIndex size,
+                           ArrayIndex axis_shape, ArrayIndex axis_stride, double sigma, int order)
+{
+    const ArrayIndex min_tasks = 4 * pool.size();
+    if (axis_stride == 1)
+    {
+        // strips of consecutive lines, a multiple of the widest SIMD vector
+        const ArrayIndex n_lines = size / axis_shape,
+                         strip = ((n_lines + min_tasks - 1) / min_tasks + 15) / 16 * 16,
+                         n_tasks = (n_lines + strip - 1) / strip;
+        pool.parallel_for(n_tasks, [&](ArrayIndex task)
+        {
+            const ArrayIndex l = task * strip;
+            AvxRecursiveGaussianLine::exec_x(in + l * axis_shape, axis_shape, std::min(strip, n_lines - l),
+                                             axis_shape, out + l * axis_shape, axis_shape, sigma, order);
+        });
+    }
+    else
+    {
+        // planes x column blocks, the recursion runs over all rows at once
+        const ArrayIndex plane = axis_shape * axis_stride;
+        parallel_column_blocks(pool, axis_stride, axis_shape, size / plane, axis_stride, 0,
+            [&](ArrayIndex p, ArrayIndex x, ArrayIndex block_width, ArrayIndex, ArrayIndex)
+            {
+                AvxRecursiveGaussianLine::exec_y(in + p * plane + x, block_width, axis_shape,
+                                                 axis_stride, out + p * plane + x, axis_stride, sigma, order);
+            });
+    }
+}
+
+template <KernelSymmetry SYMMETRY, class IN>
+void convolve_axis(WorkStealingThreadPool & pool, IN const * in, float * out, bool in_place, ArrayIndex size,
+                   ArrayIndex axis_shape, ArrayIndex axis_stride,
+                   float * kernel, ArrayIndex radius)
+{
+    if (in_place)
+        convolve_axis<SYMMETRY>(pool, out, out, size, axis_shape, axis_stride, kernel, radius);
+    else
+        convolve_axis<SYMMETRY>(pool, in, out, size, axis_shape, axis_stride, kernel, radius);
+}
+
+    // The float data of 'src', converted into 'out' unless it already is float.
+inline float * float_data(WorkStealingThreadPool &, float const * src, float *, ArrayIndex)
+{
+    return const_cast<float *>(src);
+}
+
+template <class T>
+float * float_data(WorkStealingThreadPool & pool, T const * src, float * out, ArrayIndex size)
+{
+    const ArrayIndex chunk = 1 << 16;
+    pool.parallel_for((size + chunk - 1) / chunk, [&](ArrayIndex task)
+    {
+        const ArrayIndex end = std::min(size, (task + 1) * chunk);
+        for (ArrayIndex k = task * chunk; k < end; ++k)
+            out[k] = FastFiltersConvert<T>::to_float(src[k]);
+    });
+    return out;
+}
+
+} // namespace fastfilters_detail
+
+    /** Separable Gaussian smoothing / derivative filter of an N-D array.
+
+        <tt>sigma[k]</tt> and <tt>order[k]</tt> (0, 1, or 2) specify the scale
+        and derivative order along axis k. Axes with <tt>sigma[k] == 0</tt> and
+        <tt>order[k] == 0</tt> are left unfiltered. Borders are reflected.
+
+        Both arrays must have the same shape and the same consecutive memory
+        layout (any axis permutation). The innermost axis is filtered first,
+        streaming from src to dest, all further passes run in-place on dest
+        in cache-sized column blocks, so that no full-size temporary array is
+        needed. src and dest may be the same array.
+
+        Axes with large sigma are filtered with the recursive Gaussian
+        (constant cost per pixel), see GaussianFilterOptions and
+        AvxRecursiveGaussianLine for the accuracy trade-off.
+
+        The source may also hold <tt>uint8_t</tt>, <tt>uint16_t</tt> or
+        FastFiltersHalf pixels, which the first FIR pass converts while loading
+        (see AvxConvolveLine), so that no float copy of the source is made.
+
+        The passes are distributed over the threads of <tt>pool</tt>; the
+        result does not depend on the number of threads.
+    */
+template <int N, class T>
+void fastfilters_gaussian(ArrayViewND<N, T> const & src, ArrayViewND<N, float> dest,
+                          TinyArray<double, N> const & sigma, TinyArray<int, N> const & order,
+                          WorkStealingThreadPool & pool,
+                          GaussianFilterOptions const & options = GaussianFilterOptions())
+{
+    const int ndim = src.ndim();
+
+    if (!(src.shape() == dest.shape()) || !(src.strides() == dest.strides()))
+        throw std::runtime_error("fastfilters_gaussian(): src and dest must have equal shape and memory layout.");
+
+    // axes in order of increasing stride
+    std::vector<int> axes(ndim);
+    for (int k = 0; k < ndim; ++k)
+        axes[k] = k;
+    std::sort(axes.begin(), axes.end(),
+              [&](int a, int b) { return src.strides()[a] < src.strides()[b]; });
+
+    ArrayIndex size = 1;
+    for (int k = 0; k < ndim; ++k)
+    {
+        if (src.strides()[axes[k]] != size)
+            throw std::runtime_error("fastfilters_gaussian(): arrays must be consecutive.");
+        size *= src.shape()[axes[k]];
+    }
+    if (size == 0)
+        return;
+
+    T const * in = src.data();
+    float * out = dest.data();
+    bool filtered = false;
+
+    for (int k = 0; k < ndim; ++k)
+    {
+        const int axis = axes[k];
+        if (sigma[axis] == 0.0 && order[axis] == 0)
+            continue;
+
+        if (options.use_iir(sigma[axis]))
+        {
+            float * iir_in = filtered ? out : fastfilters_detail::float_data(pool, in, out, size);
+            fastfilters_detail::recursive_axis(pool, iir_in, out, size, src.shape()[axis], src.strides()[axis],
+                                               sigma[axis], order[axis]);
+            filtered = true;
+            continue;
+        }
+
+        const ArrayIndex radius = fastfilters_gaussian_radius(sigma[axis], order[axis], options.window_ratio);
+        if (radius >= src.shape()[axis])
+            throw std::runtime_error("fastfilters_gaussian(): kernel longer than array axis.");
+
+        std::vector<float> kernel = fastfilters_gaussian_kernel(sigma[axis], order[axis], radius);
+
+        if (order[axis] % 2 == 0)
+            fastfilters_detail::convolve_axis<KernelEven>(pool, in, out, filtered, size, src.shape()[axis],
+                                                          src.strides()[axis], &kernel[0], radius);
+        else
+            fastfilters_detail::convolve_axis<KernelOdd>(pool, in, out, filtered, size, src.shape()[axis],
+                                                         src.strides()[axis], &kernel[0], radius);
+        filtered = true;
+    }
+
+    if (!filtered)
+    {
+        // no axis was filtered
+        float * data = fastfilters_detail::float_data(pool, in, out, size);
+        if (data != out)
+            std::copy(data, data + size, out);
+    }
+}
+
+    /** Single-threaded version of the above.
+    */
+template <int N, class T>
+void fastfilters_gaussian(ArrayViewND<N, T> const & src, ArrayViewND<N, float> dest,
+                          TinyArray<double, N> const & sigma, TinyArray<int, N> const & order,
+                          GaussianFilterOptions const & options = GaussianFilterOptions())
+{
+    WorkStealingThreadPool serial(1);
+    fastfilters_gaussian(src, dest, sigma, order, serial, options);
+}
+
+    /** Same as above with isotropic parameters.
+    */
+template <int N, class T>
+void fastfilters_gaussian(ArrayViewND<N, T> const & src, ArrayViewND<N, float> dest,
+                          double sigma, int order = 0,
+                          GaussianFilterOptions const & options = GaussianFilterOptions())
+{
+    fastfilters_gaussian(src, dest, TinyArray<double, N>(sigma),
+                         TinyArray<int, N>(order), options);
+}
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA2_FASTFILTERS_GAUSSIAN_HXX
@@ -0,0 +1,221 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#pragma once
+
+#ifndef VIGRA2_FASTFILTERS_IIR_HXX
+#define VIGRA2_FASTFILTERS_IIR_HXX
+
+#include <vigra2/config.hxx>
+#include <vigra2/fastfilters.hxx>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace vigra {
+
+/** \addtogroup Filters
+*/
+//@{
+
+    /** Coefficients of the third-order recursive Gaussian filter
+
+        <tt>w[i] = b*x[i] + a1*w[i-1] + a2*w[i-2] + a3*w[i-3]</tt> (causal) and
+        <tt>y[i] = b*w[i] + a1*y[i+1] + a2*y[i+2] + a3*y[i+3]</tt> (anti-causal)
+
+        after van Vliet, Young and Verbeek: "Recursive Gaussian derivative
+        filters" (ICPR 1998), and the 3x3 matrix <tt>m</tt> initializing the
+        anti-causal pass after Triggs and Sdika: "Boundary conditions for
+        Young - van Vliet recursive filtering" (IEEE TSP 2006).
+    */
+struct RecursiveGaussianCoefficients
+{
+    explicit RecursiveGaussianCoefficients(double sigma)
+    {
+        if (sigma < 0.5)
+            throw std::runtime_error("RecursiveGaussianCoefficients(): sigma must be at least 0.5.");
+
+        const double m0 = 1.16680, m1 = 1.10783, m2 = 1.40586,
+                     q = sigma < 3.556 ? -0.2568 + 0.5784 * sigma + 0.0561 * sigma * sigma
+                                       : 2.5091 + 0.9804 * (sigma - 3.556),
+                     scale = (m0 + q) * (m1 * m1 + m2 * m2 + 2.0 * m1 * q + q * q);
+
+        // With poles close to 1, 1 - (a1 + a2 + a3) is tiny (about 1e-5 at
+        // sigma 50), and rounding b and a[k] to float independently would
+        // change the DC gain b / (1 - sum(a)) by percents. Therefore, b and m
+        // are derived from the rounded a[k], which makes the gain exactly 1.
+        a[0] = (float)(q * (2.0 * m0 * m1 + m1 * m1 + m2 * m2 + (2.0 * m0 + 4.0 * m1) * q + 3.0 * q * q) / scale);
+        a[1] = (float)(-q * q * (m0 + 2.0 * m1 + 3.0 * q) / scale);
+        a[2] = (float)(q * q * q / scale);
+
+        const double d1 = a[0], d2 = a[1], d3 = a[2],
+                     bb = 1.0 - (d1 + d2 + d3);
+
+        const double s = 1.0 / ((1.0 + d1 - d2 + d3) * bb * (1.0 + d2 + (d1 - d3) * d3));
+        const double mm[9] = {
+            s * (-d3 * d1 + 1.0 - d3 * d3 - d2),
+            s * (d3 + d1) * (d2 + d3 * d1),
+            s * d3 * (d1 + d3 * d2),
+            s * (d1 + d3 * d2),
+            -s * (d2 - 1.0) * (d2 + d3 * d1),
+            -s * d3 * (d3 * d1 + d3 * d3 + d2 - 1.0),
+            s * (d3 * d1 + d2 + d1 * d1 - d2 * d2),
+            s * (d1 * d2 + d3 * d2 * d2 - d1 * d3 * d3 - d3 * d3 * d3 - d3 * d2 + d3),
+            s * d3 * (d1 + d3 * d2) };
+
+        b = (float)bb;
+        for (int k = 0; k < 9; ++k)
+            m[k] = (float)mm[k];
+    }
+
+    float b, a[3], m[9];
+};
+
+    // instantiate RecursiveGaussianLine for every SIMD backend
+#define VIGRA_FASTFILTERS_KERNELS <vigra2/fastfilters_iir_kernels.hxx>
+#include <vigra2/fastfilters_backends.hxx>
+
+    /** Recursive (IIR) Gaussian smoothing and first and second derivative.
+
+        In contrast to AvxConvolveLine, the cost per pixel is independent of
+        sigma. The filter is applied to up to Simd::size lines at once (one
+        line per SIMD lane), derivatives are central differences of the
+        smoothed signal. To match the reflective border treatment of the FIR
+        filters, each line is extended by <tt>pad_ratio * sigma</tt> reflected
+        samples, beyond which the signal is assumed constant. in == out is
+        allowed. The line buffers are taken from fastfilters_thread_workspace(),
+        so that repeated calls do not allocate memory.
+
+        Accuracy relative to the sampled FIR kernels of fastfilters_gaussian_kernel()
+        with window ratio 4, measured by <tt>bench_iir</tt> as the maximum absolute
+        difference over a 2048 x 2048 image of uniform random values in [0, 1]:
+
+        <table>
+        <tr><th>sigma</th><th>smoothing</th><th>1st derivative</th><th>2nd derivative</th></tr>
+        <tr><td>2</td><td>2.7e-2</td><td>2.2e-2</td><td>3.7e-2</td></tr>
+        <tr><td>4</td><td>1.3e-2</td><td>6.4e-3</td><td>4.5e-3</td></tr>
+        <tr><td>8</td><td>6.8e-3</td><td>1.6e-3</td><td>6.2e-4</td></tr>
+        <tr><td>16</td><td>3.8e-3</td><td>4.8e-4</td><td>9.9e-5</td></tr>
+        <tr><td>32</td><td>3.3e-3</td><td>1.6e-4</td><td>1.6e-5</td></tr>
+        <tr><td>64</td><td>3.1e-3</td><td>6.3e-5</td><td>2.9e-6</td></tr>
+        <tr><td>128</td><td>2.4e-2</td><td>1.8e-4</td><td>3.8e-6</td></tr>
+        </table>
+
+        The differences are dominated by the impulse response of the third-order
+        recursive filter, which deviates from the Gaussian by about 2-5% of its
+        peak and has a slightly wider tail; for the derivatives, the central
+        differences contribute as well. Both effects shrink with increasing
+        sigma, while the cost per pixel stays constant (FIR cost grows linearly
+        with the radius). The same benchmark reports the timings, which cross
+        over at roughly sigma 3 (y-direction) to 6 (x-direction) with AVX-512.
+        Beyond sigma 64, the three poles approach 1 so closely that rounding
+        the coefficients to float noticeably distorts the impulse response
+        (the DC gain stays exactly 1, see RecursiveGaussianCoefficients).
+        Below sigma = 0.5 the approximation breaks down and an exception is thrown.
+    */
+struct AvxRecursiveGaussianLine
+{
+    static ArrayIndex padding(double sigma, ArrayIndex size, double pad_ratio = 4.0)
+    {
+        return std::max<ArrayIndex>(1, std::min<ArrayIndex>(size - 1, (ArrayIndex)std::ceil(pad_ratio * sigma)));
+    }
+
+        /** Number of floats of scratch memory needed for lines of length
+            <tt>size</tt> by every backend.
+        */
+    static ArrayIndex workspace_size(double sigma, ArrayIndex size, double pad_ratio = 4.0)
+    {
+        return (size + 2 * padding(sigma, size, pad_ratio)) * 16;
+    }
+
+        /** Filter <tt>n_lines</tt> lines of length <tt>size</tt>, starting
+            <tt>in_stride</tt> resp. <tt>out_stride</tt> elements apart.
+        */
+    static void exec_x(float * in, ArrayIndex size, ArrayIndex n_lines, ArrayIndex in_stride,
+                       float * out, ArrayIndex out_stride,
+                       double sigma, int order, double pad_ratio = 4.0)
+    {
+        if (order < 0 || order > 2)
+            throw std::runtime_error("AvxRecursiveGaussianLine::exec_x(): order must be 0, 1 or 2.");
+        if (size < 2)
+        {
+            for (ArrayIndex l = 0; l < n_lines && size == 1; ++l)
+                out[l * out_stride] = order == 0 ? in[l * in_stride] : 0.0f;
+            return;
+        }
+
+        RecursiveGaussianCoefficients c(sigma);
+        ArrayIndex pad = padding(sigma, size, pad_ratio);
+        float * buffer = fastfilters_thread_workspace().data(workspace_size(sigma, size, pad_ratio));
+        VIGRA_FASTFILTERS_DISPATCH(RecursiveGaussianLine::exec_x(in, size, n_lines, in_stride,
+                                                                 out, out_stride, c, order, pad, buffer))
+    }
+
+        /** Filter a single line.
+        */
+    static void exec_x(float * in, ArrayIndex size, float * out,
+                       double sigma, int order, double pad_ratio = 4.0)
+    {
+        exec_x(in, size, 1, size, out, size, sigma, order, pad_ratio);
+    }
+
+        /** Filter the columns of a 2D plane.
+        */
+    static void exec_y(float * in, ArrayIndex width, ArrayIndex height, ArrayIndex in_stride,
+                       float * out, ArrayIndex out_stride,
+                       double sigma, int order, double pad_ratio = 4.0)
+    {
+        if (order < 0 || order > 2)
+            throw std::runtime_error("AvxRecursiveGaussianLine::exec_y(): order must be 0, 1 or 2.");
+        if (height < 2)
+        {
+            for (ArrayIndex x = 0; x < width && height == 1; ++x)
+                out[x] = order == 0 ? in[x] : 0.0f;
+            return;
+        }
+
+        RecursiveGaussianCoefficients c(sigma);
+        ArrayIndex pad = padding(sigma, height, pad_ratio);
+        float * buffer = fastfilters_thread_workspace().data(workspace_size(sigma, height, pad_ratio));
+        VIGRA_FASTFILTERS_DISPATCH(RecursiveGaussianLine::exec_y(in, width, height, in_stride,
+                                                                 out, out_stride, c, order, pad, buffer))
+    }
+};
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA2_FASTFILTERS_IIR_HXX
@@ -0,0 +1,217 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+// No include guard: this file is compiled once per SIMD backend via
+// fastfilters_backends.hxx and relies on the backend's 'Simd' wrapper.
+
+    // Recursive Gaussian filter vectorized across independent lines: the
+    // lines are copied into an interleaved buffer (sample i of lane j at
+    // buffer[i*N + j]), extended by 'pad' reflected samples on either side.
+    // The recursion then runs over whole vectors.
+struct RecursiveGaussianLine
+{
+    typedef Simd::vector vector;
+
+    static const ArrayIndex N = Simd::size;
+
+        // Causal and anti-causal pass over the 'n' vectors in 'buffer', in-place.
+        // Both ends are initialized as if the signal continued with its
+        // first resp. last sample (Triggs & Sdika), n >= 3.
+    static void smooth(float * buffer, ArrayIndex n, RecursiveGaussianCoefficients const & c)
+    {
+        // Since a1 = 1 - b - a2 - a3, the recursions are evaluated as
+        //     w = w1 + b*(x - w1) + a2*(w2 - w1) + a3*(w3 - w1),
+        // i.e. as small corrections to the previous output. This is exact for
+        // constant signals, whereas the direct form would drift by rounding
+        // errors amplified by 1 / (1 - a1 - a2 - a3), which is huge for large sigma.
+        const vector b  = Simd::broadcast(&c.b),
+                     a2 = Simd::broadcast(&c.a[1]),
+                     a3 = Simd::broadcast(&c.a[2]);
+
+        const vector last = Simd::load(buffer + (n - 1) * N);
+
+        // causal pass
+        vector w1 = Simd::load(buffer), w2 = w1, w3 = w1;
+        for (ArrayIndex i = 0; i < n; ++i)
+        {
+            vector w = Simd::mul(b, Simd::sub(Simd::load(buffer + i * N), w1));
+            w = Simd::fmadd(a2, Simd::sub(w2, w1), w);
+            w = Simd::fmadd(a3, Simd::sub(w3, w1), w);
+            w = Simd::add(w1, w);
+            Simd::store(buffer + i * N, w);
+            w3 = w2;
+            w2 = w1;
+            w1 = w;
+        }
+
+        // anti-causal pass: y[n-1], y[n], y[n+1] from the boundary matrix
+        const vector u0 = Simd::sub(w1, last),
+                     u1 = Simd::sub(w2, last),
+                     u2 = Simd::sub(w3, last);
+        vector y[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            vector m = Simd::mul(Simd::broadcast(&c.m[3*k]), u0);
+            m = Simd::fmadd(Simd::broadcast(&c.m[3*k + 1]), u1, m);
+            m = Simd::fmadd(Simd::broadcast(&c.m[3*k + 2]), u2, m);
+            y[k] = Simd::fmadd(b, m, last);
+        }
+        Simd::store(buffer + (n - 1) * N, y[0]);
+
+        vector y1 = y[0], y2 = y[1], y3 = y[2];
+        for (ArrayIndex i = n - 2; i >= 0; --i)
+        {
+            vector v = Simd::mul(b, Simd::sub(Simd::load(buffer + i * N), y1));
+            v = Simd::fmadd(a2, Simd::sub(y2, y1), v);
+            v = Simd::fmadd(a3, Simd::sub(y3, y1), v);
+            v = Simd::add(y1, v);
+            Simd::store(buffer + i * N, v);
+            y3 = y2;
+            y2 = y1;
+            y1 = v;
+        }
+    }
+
+        // Derivative of the given order at sample i of the smoothed buffer,
+        // approximated by central differences.
+    static vector derivative(float const * buffer, ArrayIndex i, int order)
+    {
+        static const float half = 0.5f, minus_two = -2.0f;
+        switch (order)
+        {
+        case 0:
+            return Simd::load(buffer + i * N);
+        case 1:
+            return Simd::mul(Simd::broadcast(&half),
+                             Simd::sub(Simd::load(buffer + (i + 1) * N), Simd::load(buffer + (i - 1) * N)));
+        default:
+            return Simd::fmadd(Simd::broadcast(&minus_two), Simd::load(buffer + i * N),
+                               Simd::add(Simd::load(buffer + (i + 1) * N), Simd::load(buffer + (i - 1) * N)));
+        }
+    }
+
+    static ArrayIndex reflect(ArrayIndex i, ArrayIndex size)
+    {
+        return i < 0 ? -i
+                     : i >= size ? 2 * size - 2 - i
+                                 : i;
+    }
+
+        // Filter 'n_lines' lines of length 'size' (size > pad >= 1),
+        // 'in_stride' resp. 'out_stride' elements apart. in == out is allowed.
+        // 'buffer' must be aligned and hold (size + 2*pad) * N floats.
+    static void exec_x(float * in, ArrayIndex size, ArrayIndex n_lines, ArrayIndex in_stride,
+                       float * out, ArrayIndex out_stride,
+                       RecursiveGaussianCoefficients const & c, int order, ArrayIndex pad,
+                       float * buffer)
+    {
+        const ArrayIndex n = size + 2 * pad;
+
+        for (ArrayIndex l = 0; l < n_lines; l += N)
+        {
+            const ArrayIndex lanes = n_lines - l < N ? n_lines - l : N;
+
+            // transpose N lines into the buffer line by line, unused lanes are zero
+            for (ArrayIndex j = 0; j < N; ++j)
+            {
+                float * dest = buffer + j;
+                if (j >= lanes)
+                {
+                    for (ArrayIndex i = 0; i < n; ++i)
+                        dest[i * N] = 0.0f;
+                    continue;
+                }
+
+                const float * line = in + (l + j) * in_stride;
+                for (ArrayIndex i = 0; i < pad; ++i)
+                    dest[i * N] = line[pad - i];
+                dest += pad * N;
+                for (ArrayIndex x = 0; x < size; ++x)
+                    dest[x * N] = line[x];
+                dest += size * N;
+                for (ArrayIndex i = 0; i < pad; ++i)
+                    dest[i * N] = line[size - 2 - i];
+            }
+
+            smooth(buffer, n, c);
+
+            // Shift the results to the front of the buffer. This is possible
+            // in-place because result x depends on samples >= x + pad - 1 only.
+            for (ArrayIndex x = 0; x < size; ++x)
+                Simd::store(buffer + x * N, derivative(buffer, x + pad, order));
+
+            // transpose back
+            for (ArrayIndex j = 0; j < lanes; ++j)
+            {
+                float * line = out + (l + j) * out_stride;
+                for (ArrayIndex x = 0; x < size; ++x)
+                    line[x] = buffer[x * N + j];
+            }
+        }
+    }
+
+        // Filter the columns of a 2D plane (height > pad >= 1). in == out is allowed.
+        // 'buffer' must be aligned and hold (height + 2*pad) * N floats.
+    static void exec_y(float * in, ArrayIndex width, ArrayIndex height, ArrayIndex in_stride,
+                       float * out, ArrayIndex out_stride,
+                       RecursiveGaussianCoefficients const & c, int order, ArrayIndex pad,
+                       float * buffer)
+    {
+        const ArrayIndex n = height + 2 * pad;
+
+        for (ArrayIndex x = 0; x < width; x += N)
+        {
+            const bool tail = x + N > width;
+            const Simd::mask mask = Simd::tail_mask(tail ? width - x : 0);
+
+            for (ArrayIndex i = 0; i < n; ++i)
+            {
+                const float * row = in + reflect(i - pad, height) * in_stride + x;
+                Simd::store(buffer + i * N, tail ? Simd::load_masked(row, mask)
+                                                 : Simd::load(row));
+            }
+
+            smooth(buffer, n, c);
+
+            for (ArrayIndex y = 0; y < height; ++y)
+            {
+                if (tail)
+                    Simd::store_masked(out + y * out_stride + x, derivative(buffer, y + pad, order), mask);
+                else
+                    Simd::store(out + y * out_stride + x, derivative(buffer, y + pad, order));
+            }
+        }
+    }
+};
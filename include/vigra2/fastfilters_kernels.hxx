@@ -0,0 +1,455 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+// No include guard: this file is compiled once per SIMD backend via
+// fastfilters_backends.hxx and relies on the backend's 'Simd' wrapper.
+
+template <KernelSymmetry SYMMETRY = KernelEven>
+struct SimdAddBySymmetry
+{
+    Simd::vector operator()(Simd::vector a, Simd::vector b) const
+    {
+        return Simd::add(a, b);
+    }
+};
+
+template <>
+struct SimdAddBySymmetry<KernelOdd>
+{
+    Simd::vector operator()(Simd::vector a, Simd::vector b) const
+    {
+        return Simd::sub(a, b);
+    }
+};
+
+    // Kernel coefficients broadcast to SIMD vectors. With a compile-time
+    // radius, all coefficients are broadcast once per call and, since the
+    // tap loops are fully unrolled, can be held in registers.
+template <ArrayIndex RADIUS>
+struct SimdKernel
+{
+    Simd::vector coeffs[RADIUS + 1];
+
+    SimdKernel(const float * kernel)
+    {
+        for (ArrayIndex k = 0; k <= RADIUS; ++k)
+            coeffs[k] = Simd::broadcast(kernel + k);
+    }
+
+    Simd::vector operator[](ArrayIndex k) const
+    {
+        return coeffs[k];
+    }
+};
+
+template <>
+struct SimdKernel<runtime_size>
+{
+    const float * kernel;
+
+    SimdKernel(const float * k)
+    : kernel(k)
+    {}
+
+    Simd::vector operator[](ArrayIndex k) const
+    {
+        return Simd::broadcast(kernel + k);
+    }
+};
+
+    // Call f(k) for k = 1, ..., radius in this order. With a compile-time
+    // radius, the loop is unrolled by template recursion.
+template <ArrayIndex RADIUS>
+struct TapLoop
+{
+    template <class FUNCTOR>
+    static void apply(ArrayIndex radius, FUNCTOR & f)
+    {
+        TapLoop<RADIUS - 1>::apply(radius, f);
+        f(RADIUS);
+    }
+};
+
+template <>
+struct TapLoop<0>
+{
+    template <class FUNCTOR>
+    static void apply(ArrayIndex, FUNCTOR &)
+    {}
+};
+
+template <>
+struct TapLoop<runtime_size>
+{
+    template <class FUNCTOR>
+    static void apply(ArrayIndex radius, FUNCTOR & f)
+    {
+        for (ArrayIndex k = 1; k <= radius; ++k)
+            f(k);
+    }
+};
+
+template <KernelSymmetry SYMMETRY = KernelEven, ArrayIndex RADIUS = runtime_size>
+struct ConvolveLine
+{
+    typedef Simd::vector vector;
+
+    static const ArrayIndex N = Simd::size;
+
+    template <class T>
+    static float pixel(T v)
+    {
+        return FastFiltersConvert<T>::to_float(v);
+    }
+
+    template <class IN, class OUT>
+    VIGRA_FASTFILTERS_FLATTEN
+    static void exec_x(IN const * in, ArrayIndex size, OUT * out,
+                       float * kernel, ArrayIndex radius)
+    {
+        AddBySymmetry<SYMMETRY> addsub;
+        SimdAddBySymmetry<SYMMETRY> simd_addsub;
+        RadiusLoopUnrolling<RADIUS> const_radius;
+
+        FastFiltersStopwatch stopwatch;
+
+        // FIXME: check kernel longer than line
+        ArrayIndex x = 0;
+        for (; x < const_radius(radius); ++x)
+        {
+            float sum = kernel[0] * pixel(in[x]);
+
+            for (ArrayIndex k = 1; k <= const_radius(radius); ++k)
+            {
+                ArrayIndex offset_left  = x < k ? k - x
+                                                : x - k,
+                           offset_right = likely(k + x < size) ? x + k
+                                                               : size - ((k + x) % size) - 2;
+
+                sum += kernel[k] * addsub(pixel(in[offset_right]), pixel(in[offset_left]));
+            }
+
+            out[x] = FastFiltersConvert<OUT>::from_float(sum);
+        }
+
+        const ArrayIndex body_begin = x;
+        stopwatch.lap(CounterBorderTicks);
+
+        const SimdKernel<RADIUS> coeffs(kernel);
+
+        // FIXME: check if this must be radius + 1
+        ArrayIndex steps = (size - const_radius(radius) - x) / (4*N);
+        for(ArrayIndex j = 0; j < steps; ++j, x += 4*N)
+        {
+            // load next 4*N pixels
+            vector result0 = Simd::load(in + x);
+            vector result1 = Simd::load(in + x + N);
+            vector result2 = Simd::load(in + x + 2*N);
+            vector result3 = Simd::load(in + x + 3*N);
+
+            // multiply current pixels with center value of kernel
+            result0 = Simd::mul(result0, coeffs[0]);
+            result1 = Simd::mul(result1, coeffs[0]);
+            result2 = Simd::mul(result2, coeffs[0]);
+            result3 = Simd::mul(result3, coeffs[0]);
+
+            // work on both sides of symmetric kernel simultaneously
+            auto tap = [&](ArrayIndex k)
+            {
+                // sum pixels for both sides of kernel (kernel[-j] * image[i-j] + kernel[j] * image[i+j] =
+                // (image[i-j] +
+                // image[i+j]) * kernel[j])
+                // since kernel[-j] = kernel[j] or kernel[-j] = -kernel[j]
+                vector pixels0 = simd_addsub(Simd::load(in + x + k      ), Simd::load(in + (x - k)));
+                vector pixels1 = simd_addsub(Simd::load(in + x + k +   N), Simd::load(in + (x - k) + N));
+                vector pixels2 = simd_addsub(Simd::load(in + x + k + 2*N), Simd::load(in + (x - k) + 2*N));
+                vector pixels3 = simd_addsub(Simd::load(in + x + k + 3*N), Simd::load(in + (x - k) + 3*N));
+
+                // multiply with kernel value and add to result
+                result0 = Simd::fmadd(pixels0, coeffs[k], result0);
+                result1 = Simd::fmadd(pixels1, coeffs[k], result1);
+                result2 = Simd::fmadd(pixels2, coeffs[k], result2);
+                result3 = Simd::fmadd(pixels3, coeffs[k], result3);
+            };
+            TapLoop<RADIUS>::apply(radius, tap);
+
+            Simd::store(out + x, result0);
+            Simd::store(out + x + N, result1);
+            Simd::store(out + x + 2*N, result2);
+            Simd::store(out + x + 3*N, result3);
+        }
+
+        // FIXME: check if this must be radius + 1
+        steps = (size - const_radius(radius) - x) / N;
+        for (ArrayIndex j = 0; j < steps; ++j, x += N)
+        {
+            // load next N pixels and multiply with center value of kernel
+            vector result0 = Simd::mul(Simd::load(in + x), coeffs[0]);
+
+            // work on both sides of symmetric kernel simultaneously
+            auto tap = [&](ArrayIndex k)
+            {
+                vector pixels0 = simd_addsub(Simd::load(in + x + k), Simd::load(in + (x - k)));
+
+                // multiply with kernel value and add to result
+                result0 = Simd::fmadd(pixels0, coeffs[k], result0);
+            };
+            TapLoop<RADIUS>::apply(radius, tap);
+
+            Simd::store(out + x, result0);
+        }
+
+        // FIXME: check if this must be radius + 1
+        for (; x < size - const_radius(radius); ++x)
+        {
+            float sum = kernel[0] * pixel(in[x]);
+
+            // work on both sides of symmetric kernel simultaneously
+            for (ArrayIndex k = 1; k <= const_radius(radius); ++k)
+            {
+                sum += kernel[k] * addsub(pixel(in[x + k]), pixel(in[x - k]));
+            }
+            out[x] = FastFiltersConvert<OUT>::from_float(sum);
+        }
+
+        const ArrayIndex body_end = x;
+        stopwatch.lap(CounterBodyTicks);
+
+        // right border
+        for (; x < size; ++x)
+        {
+            float sum = pixel(in[x]) * kernel[0];
+
+            for (ArrayIndex k = 1; k <= const_radius(radius); ++k)
+            {
+                float left = unlikely(x < k) ? pixel(in[k - x])
+                                             : pixel(in[x - k]),
+                      right = x + k >= size ? pixel(in[size - ((k + x) % size) - 2])
+                                            : pixel(in[x + k]);
+
+                sum += kernel[k] * addsub(right, left);
+            }
+
+            out[x] = FastFiltersConvert<OUT>::from_float(sum);
+        }
+
+        stopwatch.lap(CounterBorderTicks);
+        fastfilters_count(CounterBorderPixels, body_begin + size - body_end);
+        fastfilters_count(CounterBodyPixels, body_end - body_begin);
+    }
+
+        // Store to an output row (converting to DST, masked at the end of the row)
+        // or to an aligned and padded float scratch row.
+    template <class DST>
+    static void store_y(DST * dst, vector v, Simd::mask mask, bool tail, std::true_type)
+    {
+        if (tail)
+            Simd::store_masked(dst, v, mask);
+        else
+            Simd::store(dst, v);
+    }
+
+    static void store_y(float * dst, vector v, Simd::mask, bool, std::false_type)
+    {
+        Simd::store_aligned(dst, v);
+    }
+
+        // Convolve row 'y' in y-direction and store the result in 'dst'.
+        // If BORDER is true, rows outside [0, height) are reflected at the border.
+        // If DIRECT is true, 'dst' is an unaligned output row of exactly 'width'
+        // pixels, otherwise an aligned float scratch row padded to a multiple of N.
+    template <bool BORDER, bool DIRECT, class IN, class DST>
+    VIGRA_FASTFILTERS_FLATTEN
+    static void convolve_row_y(IN const * in, ArrayIndex height, ArrayIndex in_stride, ArrayIndex y,
+                               DST * dst, ArrayIndex simd_end, ArrayIndex simd_left,
+                               Simd::mask mask, SimdKernel<RADIUS> const & coeffs, ArrayIndex radius)
+    {
+        SimdAddBySymmetry<SYMMETRY> simd_addsub;
+
+        const IN *cur_inptr = in + y * in_stride;
+
+        // input rows y-k and y+k
+        auto row_left = [&](ArrayIndex k)
+        {
+            return BORDER && k > y
+                       ? in + (k - y) * in_stride
+                       : in + (y - k) * in_stride;
+        };
+        auto row_right = [&](ArrayIndex k)
+        {
+            return BORDER && !likely(y + k < height)
+                       ? in + (height - ((k + y) % height) - 2) * in_stride
+                       : in + (y + k) * in_stride;
+        };
+
+        ArrayIndex x;
+        for (x = 0; x < simd_end; x += N)
+        {
+            vector result = Simd::mul(Simd::load(cur_inptr + x), coeffs[0]);
+
+            auto tap = [&](ArrayIndex k)
+            {
+                vector pixels = simd_addsub(Simd::load(row_right(k) + x), Simd::load(row_left(k) + x));
+                result = Simd::fmadd(pixels, coeffs[k], result);
+            };
+            TapLoop<RADIUS>::apply(radius, tap);
+
+            store_y(dst + x, result, mask, false, std::integral_constant<bool, DIRECT>());
+        }
+
+        if (simd_left > 0)
+        {
+            vector result = Simd::mul(Simd::load_masked(cur_inptr + x, mask), coeffs[0]);
+
+            auto tap = [&](ArrayIndex k)
+            {
+                vector pixels = simd_addsub(Simd::load_masked(row_right(k) + x, mask),
+                                            Simd::load_masked(row_left(k) + x, mask));
+                result = Simd::fmadd(pixels, coeffs[k], result);
+            };
+            TapLoop<RADIUS>::apply(radius, tap);
+
+            store_y(dst + x, result, mask, true, std::integral_constant<bool, DIRECT>());
+        }
+    }
+
+        // Convolve row 'y', reflecting at the border only where needed.
+    template <bool DIRECT, class IN, class DST>
+    static void compute_row_y(IN const * in, ArrayIndex height, ArrayIndex in_stride, ArrayIndex y,
+                              DST * dst, ArrayIndex simd_end, ArrayIndex simd_left,
+                              Simd::mask mask, SimdKernel<RADIUS> const & coeffs, ArrayIndex radius)
+    {
+        RadiusLoopUnrolling<RADIUS> const_radius;
+
+        // rows closer than radius to the border need reflection
+        FastFiltersStopwatch stopwatch;
+        if (y < const_radius(radius) || y >= height - const_radius(radius))
+        {
+            convolve_row_y<true, DIRECT>(in, height, in_stride, y, dst,
+                                         simd_end, simd_left, mask, coeffs, radius);
+            stopwatch.lap(CounterBorderTicks);
+            fastfilters_count(CounterBorderPixels, simd_end + simd_left);
+        }
+        else
+        {
+            convolve_row_y<false, DIRECT>(in, height, in_stride, y, dst,
+                                          simd_end, simd_left, mask, coeffs, radius);
+            stopwatch.lap(CounterBodyTicks);
+            fastfilters_count(CounterBodyPixels, simd_end + simd_left);
+        }
+    }
+
+    template <class IN, class OUT>
+    static void exec_y(IN const * in, ArrayIndex width, ArrayIndex height, ArrayIndex in_stride,
+                       OUT * out, ArrayIndex out_stride,
+                       float * kernel, ArrayIndex radius, float * scratch)
+    {
+        exec_y_rows(in, width, height, in_stride, out, out_stride, kernel, radius, 0, height, scratch);
+    }
+
+        // Copy a padded scratch row to the output, converting to OUT.
+    static void write_row(float * out, float const * row, ArrayIndex width, ArrayIndex, Simd::mask)
+    {
+        memcpy(out, row, width * sizeof(float));
+    }
+
+    template <class OUT>
+    static void write_row(OUT * out, float const * row, ArrayIndex width, ArrayIndex simd_end, Simd::mask mask)
+    {
+        ArrayIndex x = 0;
+        for (; x < simd_end; x += N)
+            Simd::store(out + x, Simd::load(row + x));
+        if (x < width)
+            Simd::store_masked(out + x, Simd::load(row + x), mask);
+    }
+
+        // Compute output rows [y_begin, y_end) only. Input rows outside this
+        // range (up to 'radius' rows on either side) are read as halo.
+        //
+        // If 'scratch' is zero, every row is written directly to 'out', which
+        // must not overlap 'in'. Otherwise, 'scratch' must be aligned to
+        // Simd::alignment and hold (radius + 1) * (width - width % N + N) floats.
+        // It is used as a ring buffer of the last radius+1 results: a row is
+        // written to 'out' once it is no longer needed as input, so that in == out
+        // is possible. In-place operation requires the range to cover the entire plane.
+    template <class IN, class OUT>
+    static void exec_y_rows(IN const * in, ArrayIndex width, ArrayIndex height, ArrayIndex in_stride,
+                            OUT * out, ArrayIndex out_stride,
+                            float * kernel, ArrayIndex radius,
+                            ArrayIndex y_begin, ArrayIndex y_end, float * scratch)
+    {
+        RadiusLoopUnrolling<RADIUS> const_radius;
+
+        // FIXME: check kernel longer than line
+
+        const ArrayIndex simd_end = width - width % N; // round down to nearest multiple of N
+        const ArrayIndex simd_left = width - simd_end;
+        const ArrayIndex n_outer_aligned = simd_end + N;
+        const ArrayIndex ring_size = const_radius(radius) + 1;
+
+        const Simd::mask mask = Simd::tail_mask(simd_left);
+        const SimdKernel<RADIUS> coeffs(kernel);
+
+        if (!scratch)
+        {
+            for (ArrayIndex y = y_begin; y < y_end; ++y)
+                compute_row_y<true>(in, height, in_stride, y, out + y * out_stride,
+                                    simd_end, simd_left, mask, coeffs, radius);
+            return;
+        }
+
+        for (ArrayIndex y = y_begin; y < y_end; ++y)
+        {
+            float *tmpptr = scratch + (y % ring_size) * n_outer_aligned;
+
+            compute_row_y<false>(in, height, in_stride, y, tmpptr,
+                                 simd_end, simd_left, mask, coeffs, radius);
+
+            const ArrayIndex y_write = y - const_radius(radius);
+            if (y_write >= y_begin)
+            {
+                float *writeptr = scratch + (y_write % ring_size) * n_outer_aligned;
+                write_row(out + y_write * out_stride, writeptr, width, simd_end, mask);
+            }
+        }
+
+        // copy the remaining rows from scratch memory to real output
+        for (ArrayIndex y = std::max(y_begin, y_end - const_radius(radius)); y < y_end; ++y)
+        {
+            float *writeptr = scratch + (y % ring_size) * n_outer_aligned;
+            write_row(out + y * out_stride, writeptr, width, simd_end, mask);
+        }
+    }
+};
@@ -0,0 +1,369 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#pragma once
+
+#ifndef VIGRA2_FASTFILTERS_PARALLEL_HXX
+#define VIGRA2_FASTFILTERS_PARALLEL_HXX
+
+#include <vigra2/config.hxx>
+#include <vigra2/fastfilters.hxx>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vigra {
+
+/** \addtogroup Filters
+*/
+//@{
+
+    /** Thread pool with one task queue per thread and work stealing.
+
+        <tt>parallel_for(n, f)</tt> calls <tt>f(i)</tt> for <tt>i = 0..n-1</tt>,
+        distributing the calls round-robin over the queues. Each thread works on
+        its own queue first and steals from the other queues when it runs dry,
+        so that unevenly sized tasks are balanced automatically. The calling
+        thread takes part in the work, i.e. a pool of size 1 runs everything
+        sequentially without starting a thread.
+    */
+class WorkStealingThreadPool
+{
+  public:
+    typedef std::function<void()> Task;
+
+        /** Create a pool of <tt>n_threads</tt> threads including the caller
+            (default: one per hardware thread).
+        */
+    explicit WorkStealingThreadPool(int n_threads = 0)
+    : queued_(0)
+    , stop_(false)
+    {
+        if (n_threads <= 0)
+            n_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        for (int k = 0; k < n_threads; ++k)
+            queues_.emplace_back(new Queue);
+        // queue 0 belongs to the calling thread
+        for (int k = 1; k < n_threads; ++k)
+            threads_.emplace_back(&WorkStealingThreadPool::worker, this, k);
+    }
+
+    ~WorkStealingThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto & t : threads_)
+            t.join();
+    }
+
+    WorkStealingThreadPool(WorkStealingThreadPool const &) = delete;
+    WorkStealingThreadPool & operator=(WorkStealingThreadPool const &) = delete;
+
+        /** Number of threads working on a parallel_for(), including the caller.
+        */
+    int size() const
+    {
+        return (int)queues_.size();
+    }
+
+        /** Execute <tt>f(i)</tt> for <tt>i = 0..n_tasks-1</tt> and return when all
+            calls have finished. The first exception thrown by a task is rethrown.
+        */
+    template <class FUNCTOR>
+    void parallel_for(ArrayIndex n_tasks, FUNCTOR f)
+    {
+        if (n_tasks <= 0)
+            return;
+        if (size() == 1 || n_tasks == 1)
+        {
+            for (ArrayIndex i = 0; i < n_tasks; ++i)
+                f(i);
+            return;
+        }
+
+        // the last task to finish wakes up the caller
+        ArrayIndex remaining = n_tasks;
+        std::mutex done_mutex;
+        std::condition_variable done;
+        std::exception_ptr error;
+        std::mutex error_mutex;
+
+        for (ArrayIndex i = 0; i < n_tasks; ++i)
+        {
+            Queue & q = *queues_[i % size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            q.tasks.push_back([&, i]()
+            {
+                try
+                {
+                    f(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error)
+                        error = std::current_exception();
+                }
+                // notify under the lock: the caller may destroy 'done' as soon as it sees 0
+                std::lock_guard<std::mutex> lock(done_mutex);
+                if (--remaining == 0)
+                    done.notify_one();
+            });
+        }
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            queued_ += n_tasks;
+        }
+        wake_.notify_all();
+
+        // help until all queues are empty, then sleep until the tasks
+        // still running on the other threads have finished
+        while (run_one(0))
+            ;
+        {
+            std::unique_lock<std::mutex> lock(done_mutex);
+            done.wait(lock, [&]() { return remaining == 0; });
+        }
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+  private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+        // Run the newest task of queue 'index' or steal the oldest task
+        // of another queue. Returns false if all queues are empty.
+    bool run_one(int index)
+    {
+        Task task;
+        {
+            Queue & q = *queues_[index];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.tasks.empty())
+            {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            }
+        }
+        for (int k = 1; !task && k < size(); ++k)
+        {
+            Queue & q = *queues_[(index + k) % size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.tasks.empty())
+            {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+        }
+        if (!task)
+            return false;
+        --queued_;
+        task();
+        return true;
+    }
+
+    void worker(int index)
+    {
+        for (;;)
+        {
+            if (run_one(index))
+                continue;
+
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_.wait(lock, [this]() { return stop_ || queued_ > 0; });
+            if (stop_)
+                return;
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::atomic<ArrayIndex> queued_;
+    bool stop_;
+};
+
+namespace fastfilters_detail {
+
+    // Number of columns filtered at once by exec_y, chosen such that the
+    // (radius + 1)-row ring buffer (in-place) resp. the input rows of the
+    // current window stay in the L2 cache.
+inline ArrayIndex column_block(ArrayIndex radius)
+{
+    const ArrayIndex cache_floats = 256 * 1024 / sizeof(float);
+    return std::max<ArrayIndex>(64, cache_floats / (radius + 1) / 64 * 64);
+}
+
+    // Split 'n_planes' planes of 'width' columns and 'height' rows into at
+    // least 4 tasks per thread and call f(plane, x, block_width, y_begin, y_end)
+    // for each task in parallel. Columns are split into blocks that are a
+    // multiple of 64 floats and at most 'max_block' wide. If 'min_slab' > 0 and
+    // there are still too few tasks, rows are additionally split into slabs of
+    // at least 'min_slab' rows.
+template <class FUNCTOR>
+void parallel_column_blocks(WorkStealingThreadPool & pool,
+                            ArrayIndex width, ArrayIndex height, ArrayIndex n_planes,
+                            ArrayIndex max_block, ArrayIndex min_slab, FUNCTOR f)
+{
+    const ArrayIndex min_tasks = 4 * pool.size();
+
+    const ArrayIndex tasks_per_plane = (min_tasks + n_planes - 1) / n_planes,
+                     block = std::min(max_block, std::max<ArrayIndex>(64, (width / tasks_per_plane + 63) / 64 * 64)),
+                     n_blocks = (width + block - 1) / block;
+
+    ArrayIndex n_slabs = 1;
+    if (min_slab > 0 && n_planes * n_blocks < min_tasks)
+    {
+        n_slabs = (min_tasks + n_planes * n_blocks - 1) / (n_planes * n_blocks);
+        n_slabs = std::max<ArrayIndex>(1, std::min(n_slabs, height / min_slab));
+    }
+    const ArrayIndex slab = (height + n_slabs - 1) / n_slabs;
+
+    pool.parallel_for(n_planes * n_blocks * n_slabs, [&](ArrayIndex task)
+    {
+        const ArrayIndex s = task % n_slabs,
+                         b = (task / n_slabs) % n_blocks,
+                         p = task / (n_slabs * n_blocks);
+        const ArrayIndex x = b * block,
+                         y_begin = s * slab,
+                         y_end = std::min(height, y_begin + slab);
+        if (y_begin < y_end)
+            f(p, x, std::min(block, width - x), y_begin, y_end);
+    });
+}
+
+} // namespace fastfilters_detail
+
+    /** Multi-threaded version of AvxConvolveLine.
+
+        The results are bit-identical to the serial functions: every line
+        (exec_x) resp. every column (exec_y) is computed by exactly the same
+        instruction sequence, only the distribution of lines and columns over
+        the threads differs.
+    */
+template <KernelSymmetry SYMMETRY = KernelEven, ArrayIndex RADIUS = runtime_size>
+struct ParallelConvolveLine
+{
+        /** Filter <tt>n_lines</tt> lines of length <tt>size</tt>, starting
+            <tt>in_stride</tt> resp. <tt>out_stride</tt> elements apart. The lines
+            are split into strips, one task per strip. in == out is allowed.
+            Pixel types are converted as in AvxConvolveLine.
+        */
+    template <class IN, class OUT>
+    static void exec_x(WorkStealingThreadPool & pool,
+                       IN const * in, ArrayIndex size, ArrayIndex n_lines, ArrayIndex in_stride,
+                       OUT * out, ArrayIndex out_stride,
+                       float * kernel, ArrayIndex radius)
+    {
+        // a few tasks per thread for load balancing
+        const ArrayIndex n_tasks = std::min<ArrayIndex>(n_lines, 4 * pool.size()),
+                         strip = (n_lines + n_tasks - 1) / std::max<ArrayIndex>(n_tasks, 1);
+
+        pool.parallel_for(n_tasks, [&](ArrayIndex task)
+        {
+            // exec_x cannot work in-place, copy each line to the thread's workspace
+            // (supported pixel types are at most as large as float)
+            IN * line = (void const *)in == (void const *)out
+                            ? (IN *)fastfilters_thread_workspace().data(size)
+                            : 0;
+            const ArrayIndex end = std::min(n_lines, (task + 1) * strip);
+            for (ArrayIndex l = task * strip; l < end; ++l)
+            {
+                IN const * src = in + l * in_stride;
+                if (line)
+                {
+                    std::copy(src, src + size, line);
+                    src = line;
+                }
+                AvxConvolveLine<SYMMETRY, RADIUS>::exec_x(src, size, out + l * out_stride, kernel, radius);
+            }
+        });
+    }
+
+        /** Filter <tt>n_planes</tt> 2D planes (starting <tt>in_plane_stride</tt>
+            resp. <tt>out_plane_stride</tt> elements apart) along the y-axis.
+
+            Each plane is split into blocks of columns. If this results in too few
+            tasks and in != out, the columns are additionally split into slabs of
+            rows, which read radius-sized halos from their neighbours. in == out
+            is allowed. Each thread reuses its fastfilters_thread_workspace(),
+            so that no memory is allocated once the threads have warmed up.
+        */
+    template <class IN, class OUT>
+    static void exec_y(WorkStealingThreadPool & pool,
+                       IN const * in, ArrayIndex width, ArrayIndex height, ArrayIndex in_stride,
+                       OUT * out, ArrayIndex out_stride,
+                       float * kernel, ArrayIndex radius,
+                       ArrayIndex n_planes = 1, ArrayIndex in_plane_stride = 0, ArrayIndex out_plane_stride = 0)
+    {
+        // column blocks small enough for the cache, plus row slabs at least
+        // 4*radius high (to limit the halo overhead) when in != out
+        const ArrayIndex min_slab = (void const *)in != (void const *)out
+                                        ? std::max<ArrayIndex>(16, 4 * radius)
+                                        : 0;
+        fastfilters_detail::parallel_column_blocks(pool, width, height, n_planes,
+                                                   fastfilters_detail::column_block(radius), min_slab,
+            [&](ArrayIndex p, ArrayIndex x, ArrayIndex block_width, ArrayIndex y_begin, ArrayIndex y_end)
+            {
+                AvxConvolveLine<SYMMETRY, RADIUS>::exec_y_rows(in + p * in_plane_stride + x,
+                                                               block_width, height, in_stride,
+                                                               out + p * out_plane_stride + x, out_stride,
+                                                               kernel, radius, y_begin, y_end);
+            });
+    }
+};
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA2_FASTFILTERS_PARALLEL_HXX
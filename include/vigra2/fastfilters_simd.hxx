@@ -0,0 +1,682 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#pragma once
+
+#ifndef VIGRA2_FASTFILTERS_SIMD_HXX
+#define VIGRA2_FASTFILTERS_SIMD_HXX
+
+#include <vigra2/config.hxx>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define VIGRA_FASTFILTERS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+    // Each SIMD backend is compiled for its own instruction set, independent of
+    // the -march flags of the including translation unit. The code between
+    // VIGRA_FASTFILTERS_TARGET_PUSH(isa) and VIGRA_FASTFILTERS_TARGET_POP
+    // (including inline functions and templates) is generated for 'isa'.
+    // MSVC does not need this because it always accepts all intrinsics.
+#define VIGRA_FASTFILTERS_PRAGMA(...) _Pragma(#__VA_ARGS__)
+
+#if defined(__clang__)
+#define VIGRA_FASTFILTERS_TARGET_PUSH(isa) \
+    VIGRA_FASTFILTERS_PRAGMA(clang attribute push (__attribute__((target(isa))), apply_to = function))
+#define VIGRA_FASTFILTERS_TARGET_POP \
+    VIGRA_FASTFILTERS_PRAGMA(clang attribute pop)
+#elif defined(__GNUC__)
+#define VIGRA_FASTFILTERS_TARGET_PUSH(isa) \
+    VIGRA_FASTFILTERS_PRAGMA(GCC push_options) \
+    VIGRA_FASTFILTERS_PRAGMA(GCC target(isa))
+#define VIGRA_FASTFILTERS_TARGET_POP \
+    VIGRA_FASTFILTERS_PRAGMA(GCC pop_options)
+#else
+#define VIGRA_FASTFILTERS_TARGET_PUSH(isa)
+#define VIGRA_FASTFILTERS_TARGET_POP
+#endif
+
+    // Inline all calls in a function body, in particular the per-tap lambdas
+    // of the filter kernels, so that loops unrolled by template recursion
+    // become straight-line code.
+#if defined(__GNUC__)
+#define VIGRA_FASTFILTERS_FLATTEN __attribute__((flatten))
+#else
+#define VIGRA_FASTFILTERS_FLATTEN
+#endif
+
+namespace vigra {
+
+/** \addtogroup Filters
+*/
+//@{
+
+    /** Instruction sets supported by the fast filters, ordered by capability.
+    */
+enum SimdInstructionSet { SimdScalar, SimdSSE4, SimdAVX2, SimdAVX512 };
+
+inline const char * fastfilters_instruction_set_name(SimdInstructionSet isa)
+{
+    switch (isa)
+    {
+    case SimdAVX512: return "AVX-512";
+    case SimdAVX2:   return "AVX2+FMA";
+    case SimdSSE4:   return "SSE4.1";
+    default:         return "scalar";
+    }
+}
+
+    /** Determine the best instruction set supported by both the CPU and the
+        operating system (i.e. the OS saves the wide registers on context switch).
+    */
+inline SimdInstructionSet fastfilters_cpu_detect()
+{
+#if defined(VIGRA_FASTFILTERS_X86)
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return SimdAVX512;
+    // every CPU with AVX2 also supports F16C, which older compilers cannot query
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SimdAVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return SimdSSE4;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+
+    __cpuid(info, 1);
+    bool sse41   = (info[2] & (1 << 19)) != 0,
+         fma     = (info[2] & (1 << 12)) != 0,
+         osxsave = (info[2] & (1 << 27)) != 0,
+         avx     = (info[2] & (1 << 28)) != 0,
+         f16c    = (info[2] & (1 << 29)) != 0;
+
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool ymm_enabled = (xcr0 & 0x06) == 0x06,
+         zmm_enabled = (xcr0 & 0xe6) == 0xe6;
+
+    bool avx2 = false, avx512f = false;
+    if (max_leaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        avx2    = (info[1] & (1 << 5)) != 0;
+        avx512f = (info[1] & (1 << 16)) != 0;
+    }
+
+    if (avx512f && zmm_enabled)
+        return SimdAVX512;
+    if (avx && avx2 && fma && f16c && ymm_enabled)
+        return SimdAVX2;
+    if (sse41)
+        return SimdSSE4;
+#endif
+#endif
+    return SimdScalar;
+}
+
+inline SimdInstructionSet & fastfilters_instruction_set_storage()
+{
+    // initialized once, thread-safe since C++11
+    static SimdInstructionSet isa = fastfilters_cpu_detect();
+    return isa;
+}
+
+    /** The instruction set currently used by the dispatched filter functions.
+    */
+inline SimdInstructionSet fastfilters_instruction_set()
+{
+    return fastfilters_instruction_set_storage();
+}
+
+    /** Restrict the dispatched filter functions to a less capable instruction
+        set (e.g. for testing or benchmarking). Requests exceeding the CPU's
+        capabilities are clamped to the detected instruction set. Returns the
+        instruction set actually selected. Not thread-safe with respect to
+        concurrently running filters.
+    */
+inline SimdInstructionSet fastfilters_set_instruction_set(SimdInstructionSet isa)
+{
+    SimdInstructionSet detected = fastfilters_cpu_detect();
+    if (isa > detected)
+        isa = detected;
+    fastfilters_instruction_set_storage() = isa;
+    return isa;
+}
+
+    /** IEEE 754 half-precision (binary16) value, stored as its bit pattern.
+        The filters convert it to float when loading and round to nearest
+        even when storing.
+    */
+struct FastFiltersHalf
+{
+    uint16_t bits;
+};
+
+inline float fastfilters_half_to_float(FastFiltersHalf h)
+{
+    uint32_t sign = (uint32_t)(h.bits & 0x8000) << 16,
+             exponent = (h.bits >> 10) & 0x1f,
+             mantissa = h.bits & 0x3ff;
+    if (exponent == 0)
+    {
+        // zero or subnormal: mantissa * 2^-24
+        float res = (float)mantissa * 5.9604644775390625e-8f;
+        return sign ? -res : res;
+    }
+    uint32_t bits = exponent == 0x1f
+                        ? sign | 0x7f800000 | (mantissa << 13)            // inf, nan
+                        : sign | ((exponent + 112) << 23) | (mantissa << 13);
+    float res;
+    std::memcpy(&res, &bits, sizeof(res));
+    return res;
+}
+
+inline FastFiltersHalf fastfilters_float_to_half(float f)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    uint32_t abs = bits & 0x7fffffff;
+    FastFiltersHalf res;
+
+    if (abs >= 0x7f800000)
+    {
+        // inf, nan (keep nans quiet)
+        res.bits = sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+    }
+    else if (abs >= 0x477ff000)
+    {
+        // 65520 and above round to inf
+        res.bits = sign | 0x7c00;
+    }
+    else if (abs < 0x38800000)
+    {
+        // below 2^-14: subnormal, scaling by 2^24 is exact
+        float a;
+        std::memcpy(&a, &abs, sizeof(a));
+        res.bits = sign | (uint16_t)std::nearbyint(a * 16777216.0f);
+    }
+    else
+    {
+        // normal: rebias the exponent, round the mantissa to nearest even
+        uint32_t h = (abs - 0x38000000) >> 13,
+                 rest = abs & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+            ++h;
+        res.bits = sign | (uint16_t)h;
+    }
+    return res;
+}
+
+    /** Conversion between the supported pixel types and float, the type
+        of all filter arithmetic. Integer results are rounded to nearest
+        (even) and saturated, nan becomes 0.
+    */
+template <class T>
+struct FastFiltersConvert;
+
+template <>
+struct FastFiltersConvert<float>
+{
+    static float to_float(float v)   { return v; }
+    static float from_float(float v) { return v; }
+};
+
+template <>
+struct FastFiltersConvert<uint8_t>
+{
+    static float to_float(uint8_t v) { return (float)v; }
+
+    static uint8_t from_float(float v)
+    {
+        return !(v > 0.0f) ? 0 : v >= 255.0f ? 255 : (uint8_t)std::lrint(v);
+    }
+};
+
+template <>
+struct FastFiltersConvert<uint16_t>
+{
+    static float to_float(uint16_t v) { return (float)v; }
+
+    static uint16_t from_float(float v)
+    {
+        return !(v > 0.0f) ? 0 : v >= 65535.0f ? 65535 : (uint16_t)std::lrint(v);
+    }
+};
+
+template <>
+struct FastFiltersConvert<FastFiltersHalf>
+{
+    static float to_float(FastFiltersHalf v)           { return fastfilters_half_to_float(v); }
+    static FastFiltersHalf from_float(float v)         { return fastfilters_float_to_half(v); }
+};
+
+    /* The backends below wrap the intrinsics of one instruction set in a
+       common interface, so that the filter kernels can be written once:
+
+           vector           SIMD register type
+           mask             type describing the active lanes of a partial vector
+           size             number of floats per register
+           alignment        required alignment of 'store_aligned()'
+
+       All loads and stores are unaligned unless stated otherwise. Besides
+       float, load() and store() (and their masked variants) accept uint8_t,
+       uint16_t and FastFiltersHalf pointers and convert on the fly with the
+       semantics of FastFiltersConvert. Partial vectors of these types are
+       emulated through a buffer, since they only occur at the end of a row.
+    */
+namespace fastfilters_scalar {
+
+struct Simd
+{
+    typedef float vector;
+    typedef ArrayIndex mask;
+
+    static const int size = 1;
+    static const size_t alignment = 16;
+
+    static vector load(float const * p)                        { return *p; }
+    static vector load_masked(float const * p, mask)           { return *p; }
+    static vector broadcast(float const * p)                   { return *p; }
+    static void store(float * p, vector v)                     { *p = v; }
+    static void store_aligned(float * p, vector v)             { *p = v; }
+    static void store_masked(float * p, vector v, mask)        { *p = v; }
+    static vector add(vector a, vector b)                      { return a + b; }
+    static vector sub(vector a, vector b)                      { return a - b; }
+    static vector mul(vector a, vector b)                      { return a * b; }
+    static vector fmadd(vector a, vector b, vector c)          { return a * b + c; }
+    static mask tail_mask(ArrayIndex count)                    { return count; }
+
+    template <class T>
+    static vector load(T const * p)                            { return FastFiltersConvert<T>::to_float(*p); }
+    template <class T>
+    static vector load_masked(T const * p, mask)               { return load(p); }
+    template <class T>
+    static void store(T * p, vector v)                         { *p = FastFiltersConvert<T>::from_float(v); }
+    template <class T>
+    static void store_masked(T * p, vector v, mask)            { store(p, v); }
+};
+
+} // namespace fastfilters_scalar
+
+#if defined(VIGRA_FASTFILTERS_X86)
+
+VIGRA_FASTFILTERS_TARGET_PUSH("sse4.1")
+
+namespace fastfilters_sse4 {
+
+struct Simd
+{
+    typedef __m128 vector;
+    typedef ArrayIndex mask;
+
+    static const int size = 4;
+    static const size_t alignment = 16;
+
+    static vector load(float const * p)                        { return _mm_loadu_ps(p); }
+    static vector broadcast(float const * p)                   { return _mm_set1_ps(*p); }
+    static void store(float * p, vector v)                     { _mm_storeu_ps(p, v); }
+    static void store_aligned(float * p, vector v)             { _mm_store_ps(p, v); }
+    static vector add(vector a, vector b)                      { return _mm_add_ps(a, b); }
+    static vector sub(vector a, vector b)                      { return _mm_sub_ps(a, b); }
+    static vector mul(vector a, vector b)                      { return _mm_mul_ps(a, b); }
+    // no FMA before AVX2
+    static vector fmadd(vector a, vector b, vector c)          { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static mask tail_mask(ArrayIndex count)                    { return count; }
+
+    static vector load_masked(float const * p, mask count)
+    {
+        // SSE has no masked loads: gather the valid lanes into a zeroed buffer
+        float buffer[size] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (ArrayIndex k = 0; k < count; ++k)
+            buffer[k] = p[k];
+        return _mm_loadu_ps(buffer);
+    }
+
+    static void store_masked(float * p, vector v, mask count)
+    {
+        float buffer[size];
+        _mm_storeu_ps(buffer, v);
+        for (ArrayIndex k = 0; k < count; ++k)
+            p[k] = buffer[k];
+    }
+
+    static vector load(uint8_t const * p)
+    {
+        int32_t bytes;
+        std::memcpy(&bytes, p, sizeof(bytes));
+        return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes)));
+    }
+
+    static vector load(uint16_t const * p)
+    {
+        return _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64((__m128i const *)p)));
+    }
+
+    static vector load(FastFiltersHalf const * p)
+    {
+        // no F16C before AVX2
+        return _mm_setr_ps(fastfilters_half_to_float(p[0]), fastfilters_half_to_float(p[1]),
+                           fastfilters_half_to_float(p[2]), fastfilters_half_to_float(p[3]));
+    }
+
+    static __m128i round_saturate(vector v, float max_value)
+    {
+        // max(v, 0) maps nan to 0
+        return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(max_value)));
+    }
+
+    static void store(uint8_t * p, vector v)
+    {
+        __m128i i = round_saturate(v, 255.0f);
+        i = _mm_packus_epi16(_mm_packs_epi32(i, i), i);
+        int32_t bytes = _mm_cvtsi128_si32(i);
+        std::memcpy(p, &bytes, sizeof(bytes));
+    }
+
+    static void store(uint16_t * p, vector v)
+    {
+        __m128i i = round_saturate(v, 65535.0f);
+        _mm_storel_epi64((__m128i *)p, _mm_packus_epi32(i, i));
+    }
+
+    static void store(FastFiltersHalf * p, vector v)
+    {
+        float buffer[size];
+        _mm_storeu_ps(buffer, v);
+        for (int k = 0; k < size; ++k)
+            p[k] = fastfilters_float_to_half(buffer[k]);
+    }
+
+    template <class T>
+    static vector load_masked(T const * p, mask count)
+    {
+        T buffer[size] = {};
+        for (ArrayIndex k = 0; k < count; ++k)
+            buffer[k] = p[k];
+        return load(buffer);
+    }
+
+    template <class T>
+    static void store_masked(T * p, vector v, mask count)
+    {
+        T buffer[size];
+        store(buffer, v);
+        for (ArrayIndex k = 0; k < count; ++k)
+            p[k] = buffer[k];
+    }
+};
+
+} // namespace fastfilters_sse4
+
+VIGRA_FASTFILTERS_TARGET_POP
+
+VIGRA_FASTFILTERS_TARGET_PUSH("avx2,fma,f16c")
+
+namespace fastfilters_avx2 {
+
+struct Simd
+{
+    typedef __m256 vector;
+    typedef __m256i mask;
+
+    static const int size = 8;
+    static const size_t alignment = 32;
+
+    static vector load(float const * p)                        { return _mm256_loadu_ps(p); }
+    static vector load_masked(float const * p, mask m)         { return _mm256_maskload_ps(p, m); }
+    static vector broadcast(float const * p)                   { return _mm256_broadcast_ss(p); }
+    static void store(float * p, vector v)                     { _mm256_storeu_ps(p, v); }
+    static void store_aligned(float * p, vector v)             { _mm256_store_ps(p, v); }
+    static void store_masked(float * p, vector v, mask m)      { _mm256_maskstore_ps(p, m, v); }
+    static vector add(vector a, vector b)                      { return _mm256_add_ps(a, b); }
+    static vector sub(vector a, vector b)                      { return _mm256_sub_ps(a, b); }
+    static vector mul(vector a, vector b)                      { return _mm256_mul_ps(a, b); }
+    static vector fmadd(vector a, vector b, vector c)          { return _mm256_fmadd_ps(a, b, c); }
+
+    static mask tail_mask(ArrayIndex count)
+    {
+        // lane k is active iff k < count
+        return _mm256_cmpgt_epi32(_mm256_set1_epi32((int)count),
+                                  _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    }
+
+    static ArrayIndex tail_count(mask m)
+    {
+        int bits = _mm256_movemask_ps(_mm256_castsi256_ps(m));
+        ArrayIndex count = 0;
+        while (bits & (1 << count))
+            ++count;
+        return count;
+    }
+
+    static vector load(uint8_t const * p)
+    {
+        return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const *)p)));
+    }
+
+    static vector load(uint16_t const * p)
+    {
+        return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i const *)p)));
+    }
+
+    static vector load(FastFiltersHalf const * p)
+    {
+        return _mm256_cvtph_ps(_mm_loadu_si128((__m128i const *)p));
+    }
+
+    static __m256i round_saturate(vector v, float max_value)
+    {
+        // max(v, 0) maps nan to 0
+        return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()),
+                                                _mm256_set1_ps(max_value)));
+    }
+
+    static void store(uint8_t * p, vector v)
+    {
+        __m256i i = round_saturate(v, 255.0f);
+        __m128i i16 = _mm_packs_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+        _mm_storel_epi64((__m128i *)p, _mm_packus_epi16(i16, i16));
+    }
+
+    static void store(uint16_t * p, vector v)
+    {
+        __m256i i = round_saturate(v, 65535.0f);
+        _mm_storeu_si128((__m128i *)p, _mm_packus_epi32(_mm256_castsi256_si128(i),
+                                                        _mm256_extracti128_si256(i, 1)));
+    }
+
+    static void store(FastFiltersHalf * p, vector v)
+    {
+        _mm_storeu_si128((__m128i *)p, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+    }
+
+    template <class T>
+    static vector load_masked(T const * p, mask m)
+    {
+        T buffer[size] = {};
+        for (ArrayIndex k = 0; k < tail_count(m); ++k)
+            buffer[k] = p[k];
+        return load(buffer);
+    }
+
+    template <class T>
+    static void store_masked(T * p, vector v, mask m)
+    {
+        T buffer[size];
+        store(buffer, v);
+        for (ArrayIndex k = 0; k < tail_count(m); ++k)
+            p[k] = buffer[k];
+    }
+};
+
+} // namespace fastfilters_avx2
+
+VIGRA_FASTFILTERS_TARGET_POP
+
+VIGRA_FASTFILTERS_TARGET_PUSH("avx512f")
+
+namespace fastfilters_avx512 {
+
+struct Simd
+{
+    typedef __m512 vector;
+    typedef __mmask16 mask;
+
+    static const int size = 16;
+    static const size_t alignment = 64;
+
+    static vector load(float const * p)                        { return _mm512_loadu_ps(p); }
+    static vector load_masked(float const * p, mask m)         { return _mm512_maskz_loadu_ps(m, p); }
+    static vector broadcast(float const * p)                   { return _mm512_set1_ps(*p); }
+    static void store(float * p, vector v)                     { _mm512_storeu_ps(p, v); }
+    static void store_aligned(float * p, vector v)             { _mm512_store_ps(p, v); }
+    static void store_masked(float * p, vector v, mask m)      { _mm512_mask_storeu_ps(p, m, v); }
+    static vector add(vector a, vector b)                      { return _mm512_add_ps(a, b); }
+    static vector sub(vector a, vector b)                      { return _mm512_sub_ps(a, b); }
+    static vector mul(vector a, vector b)                      { return _mm512_mul_ps(a, b); }
+    static vector fmadd(vector a, vector b, vector c)          { return _mm512_fmadd_ps(a, b, c); }
+    static mask tail_mask(ArrayIndex count)                    { return (mask)((1u << count) - 1u); }
+
+    static ArrayIndex tail_count(mask m)
+    {
+        ArrayIndex count = 0;
+        while (m & (1u << count))
+            ++count;
+        return count;
+    }
+
+    // The conversions below use the zero-masked intrinsics with all lanes
+    // active: the unmasked ones trigger spurious -Wmaybe-uninitialized
+    // warnings with GCC 12, the generated instructions are the same.
+    static const mask all = 0xffff;
+
+    static vector load(uint8_t const * p)
+    {
+        return _mm512_maskz_cvtepi32_ps(all, _mm512_maskz_cvtepu8_epi32(all, _mm_loadu_si128((__m128i const *)p)));
+    }
+
+    static vector load(uint16_t const * p)
+    {
+        return _mm512_maskz_cvtepi32_ps(all, _mm512_maskz_cvtepu16_epi32(all,
+                                                                         _mm256_loadu_si256((__m256i const *)p)));
+    }
+
+    static vector load(FastFiltersHalf const * p)
+    {
+        return _mm512_maskz_cvtph_ps(all, _mm256_loadu_si256((__m256i const *)p));
+    }
+
+    static __m512i round_saturate(vector v, float max_value)
+    {
+        // max(v, 0) maps nan to 0
+        return _mm512_maskz_cvtps_epi32(all, _mm512_maskz_min_ps(all, _mm512_maskz_max_ps(all, v, _mm512_setzero_ps()),
+                                                                 _mm512_set1_ps(max_value)));
+    }
+
+    static void store_masked(uint8_t * p, vector v, mask m)
+    {
+        _mm512_mask_cvtepi32_storeu_epi8(p, m, round_saturate(v, 255.0f));
+    }
+
+    static void store_masked(uint16_t * p, vector v, mask m)
+    {
+        _mm512_mask_cvtepi32_storeu_epi16(p, m, round_saturate(v, 65535.0f));
+    }
+
+    static void store(uint8_t * p, vector v)                   { store_masked(p, v, all); }
+    static void store(uint16_t * p, vector v)                  { store_masked(p, v, all); }
+
+    static void store(FastFiltersHalf * p, vector v)
+    {
+        _mm256_storeu_si256((__m256i *)p, _mm512_maskz_cvtps_ph(all, v, _MM_FROUND_TO_NEAREST_INT));
+    }
+
+    // byte and word masked loads require AVX-512BW
+    template <class T>
+    static vector load_masked(T const * p, mask m)
+    {
+        T buffer[size] = {};
+        for (ArrayIndex k = 0; k < tail_count(m); ++k)
+            buffer[k] = p[k];
+        return load(buffer);
+    }
+
+    static void store_masked(FastFiltersHalf * p, vector v, mask m)
+    {
+        FastFiltersHalf buffer[size];
+        store(buffer, v);
+        for (ArrayIndex k = 0; k < tail_count(m); ++k)
+            p[k] = buffer[k];
+    }
+};
+
+} // namespace fastfilters_avx512
+
+VIGRA_FASTFILTERS_TARGET_POP
+
+#endif // VIGRA_FASTFILTERS_X86
+
+    /* Call a kernel of the backend selected by fastfilters_instruction_set(),
+       e.g. VIGRA_FASTFILTERS_DISPATCH(ConvolveLine<KernelEven>::exec_x(...)).
+       The kernels themselves are instantiated once per backend namespace via
+       fastfilters_backends.hxx.
+    */
+#if defined(VIGRA_FASTFILTERS_X86)
+#define VIGRA_FASTFILTERS_DISPATCH(...) \
+    switch (fastfilters_instruction_set()) \
+    { \
+    case SimdAVX512: fastfilters_avx512::__VA_ARGS__; break; \
+    case SimdAVX2:   fastfilters_avx2::__VA_ARGS__; break; \
+    case SimdSSE4:   fastfilters_sse4::__VA_ARGS__; break; \
+    default:         fastfilters_scalar::__VA_ARGS__; break; \
+    }
+#else
+#define VIGRA_FASTFILTERS_DISPATCH(...) fastfilters_scalar::__VA_ARGS__
+#endif
+
+//@}
+
+} // namespace vigra
+
+#endif // VIGRA2_FASTFILTERS_SIMD_HXX
@@ -0,0 +1,243 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+// Benchmark of AvxConvolveLine against a naive scalar convolution.
+//
+// usage: bench_fastfilters [results.csv [max_width]]
+//
+// Sweeps image size (up to max_width x max_width, default 2048), radius,
+// kernel symmetry, row stride and filter axis, and prints for each case the
+// time per pixel, throughput in pixels/s and GB/s (one float read and written
+// per pixel), fastfilters_ticks() per pixel (time stamp counter cycles on x86)
+// and the speedup over the naive reference. The results are also written to
+// 'results.csv' (if given), one line per case, for tracking over time.
+//
+// When compiled with VIGRA_FASTFILTERS_INSTRUMENTATION=1 (CMake target
+// bench_fastfilters_instrumented), the ticks per pixel are also reported
+// separately for the border and the body of the lines resp. planes, and the
+// number of scratch buffer allocations. Each case is checked against the
+// reference; the exit code is the number of mismatches.
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <vigra2/fastfilters.hxx>
+#include <vigra2/fastfilters_gaussian.hxx>
+
+using namespace vigra;
+
+struct Timing
+{
+    double seconds;
+    uint64_t ticks;
+};
+
+template <class FUNCTOR>
+Timing best_time(int repeats, FUNCTOR f)
+{
+    Timing best = { 1e100, 0 };
+    for (int repeat = 0; repeat < repeats; ++repeat)
+    {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t start_ticks = fastfilters_ticks();
+        f();
+        uint64_t ticks = fastfilters_ticks() - start_ticks;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() < best.seconds)
+            best = Timing{ elapsed.count(), ticks };
+    }
+    return best;
+}
+
+    // straightforward convolution with reflective borders, 'step' apart along the filter axis
+void naive_convolve(float const * in, float * out, ArrayIndex size, ArrayIndex step,
+                    std::vector<float> const & kernel, bool odd)
+{
+    const ArrayIndex radius = (ArrayIndex)kernel.size() - 1;
+    for (ArrayIndex i = 0; i < size; ++i)
+    {
+        float sum = kernel[0] * in[i * step];
+        for (ArrayIndex k = 1; k <= radius; ++k)
+        {
+            ArrayIndex left = std::abs(i - k),
+                       right = i + k < size ? i + k : 2 * size - 2 - i - k;
+            sum += odd ? kernel[k] * (in[right * step] - in[left * step])
+                       : kernel[k] * (in[right * step] + in[left * step]);
+        }
+        out[i * step] = sum;
+    }
+}
+
+void naive_filter(float const * in, float * out, ArrayIndex width, ArrayIndex height, ArrayIndex stride,
+                  int axis, std::vector<float> const & kernel, bool odd)
+{
+    if (axis == 0)
+        for (ArrayIndex y = 0; y < height; ++y)
+            naive_convolve(in + y * stride, out + y * stride, width, 1, kernel, odd);
+    else
+        for (ArrayIndex x = 0; x < width; ++x)
+            naive_convolve(in + x, out + x, height, stride, kernel, odd);
+}
+
+template <KernelSymmetry SYMMETRY>
+void fast_filter(float * in, float * out, ArrayIndex width, ArrayIndex height, ArrayIndex stride,
+                 int axis, std::vector<float> & kernel)
+{
+    const ArrayIndex radius = (ArrayIndex)kernel.size() - 1;
+    if (axis == 0)
+        for (ArrayIndex y = 0; y < height; ++y)
+            AvxConvolveLine<SYMMETRY>::exec_x(in + y * stride, width, out + y * stride, &kernel[0], radius);
+    else
+        AvxConvolveLine<SYMMETRY>::exec_y(in, width, height, stride, out, stride, &kernel[0], radius);
+}
+
+int main(int argc, char ** argv)
+{
+    std::ofstream csv;
+    if (argc >= 2)
+        csv.open(argv[1]);
+    csv << std::fixed;
+    const ArrayIndex max_width = argc >= 3 ? std::atol(argv[2]) : 2048;
+
+    const char * isa = fastfilters_instruction_set_name(fastfilters_instruction_set());
+    std::cout << "instruction set " << isa
+              << (VIGRA_FASTFILTERS_INSTRUMENTATION ? ", instrumented" : "") << "\n\n" << std::fixed
+              << "axis sym  width height stride radius    ns/px  Mpx/s   GB/s  ticks/px  speedup";
+    if (VIGRA_FASTFILTERS_INSTRUMENTATION)
+        std::cout << "  border/px  body/px  allocs";
+    std::cout << "\n";
+    if (csv)
+    {
+        csv << "isa,axis,symmetry,width,height,stride,radius,seconds,pixels_per_second,gb_per_second,"
+               "ticks_per_pixel,reference_seconds,speedup,max_error";
+        if (VIGRA_FASTFILTERS_INSTRUMENTATION)
+            csv << ",border_ticks_per_pixel,body_ticks_per_pixel,scratch_allocations";
+        csv << "\n";
+    }
+
+    int mismatches = 0;
+    for (ArrayIndex width : { 64, 512, 2048, 8192 })
+    {
+        if (width > max_width)
+            break;
+        const ArrayIndex height = width;
+        const double pixels = (double)width * height;
+        // more repetitions for small images to reduce the timer noise
+        const int repeats = std::max<int>(3, (int)(1e7 / pixels));
+
+        // dense rows, rows misaligned by one pixel, every other row
+        for (ArrayIndex stride : { width, width + 1, 2 * width })
+        {
+            std::vector<float> image(stride * height), res(stride * height), ref(stride * height);
+            std::srand(42);
+            for (auto & v : image)
+                v = (float)std::rand() / RAND_MAX;
+
+            for (ArrayIndex radius : { 1, 2, 3, 5, 8, 12, 16, 24 })
+            {
+                if (radius >= width)
+                    continue;
+                for (int odd = 0; odd < 2; ++odd)
+                {
+                    std::vector<float> kernel = fastfilters_gaussian_kernel(radius / 3.0, odd, radius);
+                    for (int axis = 0; axis < 2; ++axis)
+                    {
+                        Timing reference = best_time(1, [&]() {
+                            naive_filter(&image[0], &ref[0], width, height, stride, axis, kernel, odd != 0);
+                        });
+                        fastfilters_reset_statistics();
+                        Timing fast = best_time(repeats, [&]() {
+                            if (odd)
+                                fast_filter<KernelOdd>(&image[0], &res[0], width, height, stride, axis, kernel);
+                            else
+                                fast_filter<KernelEven>(&image[0], &res[0], width, height, stride, axis, kernel);
+                        });
+                        FastFiltersStatistics statistics = fastfilters_statistics();
+
+                        double max_error = 0.0;
+                        for (ArrayIndex y = 0; y < height; ++y)
+                            for (ArrayIndex x = 0; x < width; ++x)
+                                max_error = std::max(max_error, (double)std::abs(res[y * stride + x] - ref[y * stride + x]));
+                        if (max_error > 1e-4)
+                            ++mismatches;
+
+                        const double gb_per_second = 2.0 * sizeof(float) * pixels / fast.seconds * 1e-9,
+                                     ticks_per_pixel = fast.ticks / pixels,
+                                     border_ticks = statistics.border_pixels
+                                                        ? (double)statistics.border_ticks / statistics.border_pixels
+                                                        : 0.0,
+                                     body_ticks = statistics.body_pixels
+                                                        ? (double)statistics.body_ticks / statistics.body_pixels
+                                                        : 0.0;
+
+                        std::cout << (axis ? "   y " : "   x ") << (odd ? "odd " : "even")
+                                  << std::setw(7) << width << std::setw(7) << height << std::setw(7) << stride
+                                  << std::setw(7) << radius << std::setprecision(3)
+                                  << std::setw(9) << 1e9 * fast.seconds / pixels
+                                  << std::setprecision(0) << std::setw(7) << pixels / fast.seconds * 1e-6
+                                  << std::setprecision(2) << std::setw(7) << gb_per_second
+                                  << std::setw(10) << ticks_per_pixel
+                                  << std::setprecision(1) << std::setw(9) << reference.seconds / fast.seconds;
+                        if (VIGRA_FASTFILTERS_INSTRUMENTATION)
+                            std::cout << std::setprecision(2) << std::setw(11) << border_ticks
+                                      << std::setw(9) << body_ticks << std::setw(8) << statistics.scratch_allocations;
+                        std::cout << (max_error > 1e-4 ? "  MISMATCH\n" : "\n");
+
+                        if (csv)
+                        {
+                            csv << isa << "," << (axis ? "y" : "x") << "," << (odd ? "odd" : "even") << ","
+                                << width << "," << height << "," << stride << "," << radius << ","
+                                << std::setprecision(9) << fast.seconds << "," << std::setprecision(0)
+                                << pixels / fast.seconds << "," << std::setprecision(4) << gb_per_second << ","
+                                << ticks_per_pixel << "," << std::setprecision(9) << reference.seconds << ","
+                                << std::setprecision(3) << reference.seconds / fast.seconds << ","
+                                << std::scientific << max_error << std::fixed;
+                            if (VIGRA_FASTFILTERS_INSTRUMENTATION)
+                                csv << "," << std::setprecision(4) << border_ticks << "," << body_ticks
+                                    << "," << statistics.scratch_allocations;
+                            csv << "\n";
+                        }
+                    }
+                }
+            }
+        }
+    }
+    if (mismatches)
+        std::cout << "\nERROR: " << mismatches << " results differ from the reference\n";
+    return mismatches;
+}
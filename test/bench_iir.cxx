@@ -0,0 +1,139 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+// Accuracy and speed of the recursive Gaussian (AvxRecursiveGaussianLine)
+// compared to the FIR filters (AvxConvolveLine).
+//
+// usage: bench_iir [width height]
+//
+// For each sigma and derivative order, prints the maximum absolute
+// difference between IIR and FIR results on a random signal in [0, 1]
+// (FIR window ratio 4), and the time per pixel of both methods in x- and
+// y-direction on a width x height image (default 2048 x 2048).
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <vigra2/fastfilters_gaussian.hxx>
+#include <vigra2/fastfilters_iir.hxx>
+
+using namespace vigra;
+
+template <class FUNCTOR>
+double best_time(FUNCTOR f)
+{
+    double best = 1e100;
+    for (int repeat = 0; repeat < 5; ++repeat)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+void fir_x(float * in, ArrayIndex width, ArrayIndex height, float * out,
+           std::vector<float> & kernel, int order)
+{
+    ArrayIndex radius = (ArrayIndex)kernel.size() - 1;
+    for (ArrayIndex y = 0; y < height; ++y)
+    {
+        if (order % 2)
+            AvxConvolveLine<KernelOdd>::exec_x(in + y * width, width, out + y * width, &kernel[0], radius);
+        else
+            AvxConvolveLine<KernelEven>::exec_x(in + y * width, width, out + y * width, &kernel[0], radius);
+    }
+}
+
+void fir_y(float * in, ArrayIndex width, ArrayIndex height, float * out,
+           std::vector<float> & kernel, int order)
+{
+    ArrayIndex radius = (ArrayIndex)kernel.size() - 1;
+    if (order % 2)
+        AvxConvolveLine<KernelOdd>::exec_y(in, width, height, width, out, width, &kernel[0], radius);
+    else
+        AvxConvolveLine<KernelEven>::exec_y(in, width, height, width, out, width, &kernel[0], radius);
+}
+
+int main(int argc, char ** argv)
+{
+    ArrayIndex width = argc >= 3 ? std::atol(argv[1]) : 2048,
+               height = argc >= 3 ? std::atol(argv[2]) : 2048;
+
+    std::vector<float> image(width * height), fir(width * height), iir(width * height);
+    std::srand(42);
+    for (auto & v : image)
+        v = (float)std::rand() / RAND_MAX;
+
+    std::cout << "instruction set " << fastfilters_instruction_set_name(fastfilters_instruction_set())
+              << ", image " << width << " x " << height << "\n\n" << std::fixed
+              << "sigma order   max error   FIR x [ns/px]   IIR x [ns/px]   FIR y [ns/px]   IIR y [ns/px]\n";
+
+    const double pixels = (double)width * height;
+    for (double sigma : { 1.0, 2.0, 3.0, 4.0, 6.0, 8.0, 12.0, 16.0, 32.0, 64.0, 128.0 })
+    {
+        for (int order = 0; order <= 2; ++order)
+        {
+            std::vector<float> kernel = fastfilters_gaussian_kernel(sigma, order,
+                                                                    fastfilters_gaussian_radius(sigma, order, 4.0));
+
+            // accuracy (all rows, x-direction)
+            fir_x(&image[0], width, height, &fir[0], kernel, order);
+            AvxRecursiveGaussianLine::exec_x(&image[0], width, height, width, &iir[0], width, sigma, order);
+            double error = 0.0;
+            for (std::size_t k = 0; k < image.size(); ++k)
+                error = std::max(error, (double)std::abs(fir[k] - iir[k]));
+
+            double fir_x_time = best_time([&]() { fir_x(&image[0], width, height, &fir[0], kernel, order); }),
+                   iir_x_time = best_time([&]() {
+                       AvxRecursiveGaussianLine::exec_x(&image[0], width, height, width, &iir[0], width, sigma, order); }),
+                   fir_y_time = best_time([&]() { fir_y(&image[0], width, height, &fir[0], kernel, order); }),
+                   iir_y_time = best_time([&]() {
+                       AvxRecursiveGaussianLine::exec_y(&image[0], width, height, width, &iir[0], width, sigma, order); });
+
+            std::cout << std::setw(5) << std::setprecision(0) << sigma << std::setw(6) << order
+                      << std::setw(12) << std::scientific << std::setprecision(1) << error << std::fixed
+                      << std::setw(16) << std::setprecision(2) << 1e9 * fir_x_time / pixels
+                      << std::setw(16) << 1e9 * iir_x_time / pixels
+                      << std::setw(16) << 1e9 * fir_y_time / pixels
+                      << std::setw(16) << 1e9 * iir_y_time / pixels << "\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+// Scaling benchmark of the multi-threaded separable filters.
+//
+// usage: bench_parallel [width height depth [sigma [max_threads]]]
+//
+// Filters a float volume (default 1024 x 1024 x 64) with a 3D Gaussian
+// gradient component and reports run time, throughput and speedup relative
+// to one thread for 1, 2, 4, ... threads. Each result is checked to be
+// bit-identical to the single-threaded one.
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vigra2/fastfilters_gaussian.hxx>
+#include <vigra2/fastfilters_parallel.hxx>
+
+using namespace vigra;
+
+int main(int argc, char ** argv)
+{
+    Shape<3> shape{ 1024, 1024, 64 };
+    if (argc >= 4)
+        shape = Shape<3>{ std::atol(argv[1]), std::atol(argv[2]), std::atol(argv[3]) };
+    double sigma = argc >= 5 ? std::atof(argv[4]) : 2.0;
+    int max_threads = argc >= 6 ? std::atoi(argv[5])
+                                : (int)std::max(1u, std::thread::hardware_concurrency());
+
+    ArrayND<3, float> src(shape), dest(shape), reference(shape);
+    for (ArrayIndex k = 0; k < src.size(); ++k)
+        src.data()[k] = (float)((k * 7919) % 256);
+
+    TinyArray<double, 3> sigmas(sigma);
+    TinyArray<int, 3> order{ 1, 0, 0 };
+    const double bytes = 3.0 * 2.0 * src.size() * sizeof(float); // one read and write per pass
+
+    std::cout << "volume " << shape[0] << " x " << shape[1] << " x " << shape[2]
+              << ", sigma " << sigma << ", instruction set "
+              << fastfilters_instruction_set_name(fastfilters_instruction_set()) << "\n\n"
+              << "threads    time [ms]    GB/s    speedup\n";
+
+    double t1 = 0.0;
+    for (int n_threads = 1; ; n_threads = std::min(2 * n_threads, max_threads))
+    {
+        WorkStealingThreadPool pool(n_threads);
+        fastfilters_gaussian(src, dest, sigmas, order, pool); // warm-up
+
+        double best = 1e100;
+        for (int repeat = 0; repeat < 5; ++repeat)
+        {
+            auto start = std::chrono::steady_clock::now();
+            fastfilters_gaussian(src, dest, sigmas, order, pool);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+
+        if (n_threads == 1)
+        {
+            t1 = best;
+            std::copy(dest.data(), dest.data() + dest.size(), reference.data());
+        }
+        else if (!std::equal(dest.data(), dest.data() + dest.size(), reference.data()))
+        {
+            std::cerr << "error: result with " << n_threads << " threads differs from serial result\n";
+            return 1;
+        }
+
+        std::cout << std::setw(7) << n_threads
+                  << std::setw(13) << std::fixed << std::setprecision(1) << 1e3 * best
+                  << std::setw(8) << std::setprecision(2) << bytes / best * 1e-9
+                  << std::setw(11) << t1 / best << "\n";
+
+        if (n_threads == max_threads)
+            break;
+    }
+    return 0;
+}
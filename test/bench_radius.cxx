@@ -0,0 +1,140 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+// Speed of the radius-specialized kernels of AvxConvolveLine compared to
+// the generic kernel with a runtime radius.
+//
+// usage: bench_radius [width height [max_radius]]
+//
+// For each radius, prints the time per pixel in x- and y-direction on a
+// width x height image (default 2048 x 2048) with the specializations
+// disabled (fastfilters_set_unrolled_radius(0)) and enabled, and the
+// resulting speedup. Both variants must agree up to rounding.
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <vigra2/fastfilters.hxx>
+
+using namespace vigra;
+
+template <class FUNCTOR>
+double best_time(FUNCTOR f)
+{
+    double best = 1e100;
+    for (int repeat = 0; repeat < 5; ++repeat)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+void filter_x(float * in, ArrayIndex width, ArrayIndex height, float * out,
+              std::vector<float> & kernel)
+{
+    ArrayIndex radius = (ArrayIndex)kernel.size() - 1;
+    for (ArrayIndex y = 0; y < height; ++y)
+        AvxConvolveLine<KernelEven>::exec_x(in + y * width, width, out + y * width, &kernel[0], radius);
+}
+
+void filter_y(float * in, ArrayIndex width, ArrayIndex height, float * out,
+              std::vector<float> & kernel)
+{
+    ArrayIndex radius = (ArrayIndex)kernel.size() - 1;
+    AvxConvolveLine<KernelEven>::exec_y(in, width, height, width, out, width, &kernel[0], radius);
+}
+
+int main(int argc, char ** argv)
+{
+    ArrayIndex width = argc >= 3 ? std::atol(argv[1]) : 2048,
+               height = argc >= 3 ? std::atol(argv[2]) : 2048,
+               max_radius = argc >= 4 ? std::atol(argv[3]) : VIGRA_FASTFILTERS_MAX_UNROLLED_RADIUS + 4;
+
+    std::vector<float> image(width * height), generic(width * height), unrolled(width * height);
+    std::srand(42);
+    for (auto & v : image)
+        v = (float)std::rand() / RAND_MAX;
+
+    std::cout << "instruction set " << fastfilters_instruction_set_name(fastfilters_instruction_set())
+              << ", image " << width << " x " << height
+              << ", specialized radii <= " << VIGRA_FASTFILTERS_MAX_UNROLLED_RADIUS << "\n\n" << std::fixed
+              << "radius   generic x   unrolled x   speedup   generic y   unrolled y   speedup   [ns/px]\n";
+
+    const double pixels = (double)width * height;
+    int mismatches = 0;
+    for (ArrayIndex radius = 1; radius <= max_radius; ++radius)
+    {
+        std::vector<float> kernel(radius + 1);
+        for (ArrayIndex k = 0; k <= radius; ++k)
+            kernel[k] = 1.0f / (2 * radius + 1);
+
+        double time[2][2];
+        bool mismatch = false;
+        for (int direction = 0; direction < 2; ++direction)
+        {
+            for (int unroll = 0; unroll < 2; ++unroll)
+            {
+                fastfilters_set_unrolled_radius(unroll ? VIGRA_FASTFILTERS_MAX_UNROLLED_RADIUS : 0);
+                std::vector<float> & out = unroll ? unrolled : generic;
+                time[unroll][direction] = best_time([&]() {
+                    if (direction == 0)
+                        filter_x(&image[0], width, height, &out[0], kernel);
+                    else
+                        filter_y(&image[0], width, height, &out[0], kernel);
+                });
+            }
+            for (std::size_t k = 0; k < image.size(); ++k)
+                mismatch = mismatch || std::abs(generic[k] - unrolled[k]) > 1e-5f;
+        }
+        if (mismatch)
+            ++mismatches;
+
+        std::cout << std::setw(6) << radius << std::setprecision(3)
+                  << std::setw(12) << 1e9 * time[0][0] / pixels
+                  << std::setw(13) << 1e9 * time[1][0] / pixels
+                  << std::setw(10) << std::setprecision(2) << time[0][0] / time[1][0] << std::setprecision(3)
+                  << std::setw(12) << 1e9 * time[0][1] / pixels
+                  << std::setw(13) << 1e9 * time[1][1] / pixels
+                  << std::setw(10) << std::setprecision(2) << time[0][1] / time[1][1] << "\n";
+    }
+    if (mismatches)
+        std::cout << "\nERROR: specialized and generic results differ for " << mismatches << " radii\n";
+    return mismatches ? 1 : 0;
+}
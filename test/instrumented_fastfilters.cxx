@@ -0,0 +1,150 @@
+/************************************************************************/
+/*                                                                      */
+/*               Copyright 2014-2017 by Ullrich Koethe                  */
+/*                                                                      */
+/*    This file is part of the VIGRA2 computer vision library.          */
+/*    The VIGRA2 Website is                                             */
+/*        http://ukoethe.github.io/vigra2                               */
+/*    Please direct questions, bug reports, and contributions to        */
+/*        ullrich.koethe@iwr.uni-heidelberg.de    or                    */
+/*        vigra@informatik.uni-hamburg.de                               */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+// Checks of the hot-path counters, built with VIGRA_FASTFILTERS_INSTRUMENTATION=1
+// (see test/CMakeLists.txt).
+
+#include <iostream>
+#include <vector>
+#include <vigra2/unittest.hxx>
+#include <vigra2/fastfilters.hxx>
+
+#if !VIGRA_FASTFILTERS_INSTRUMENTATION
+#error "instrumented_fastfilters.cxx must be compiled with VIGRA_FASTFILTERS_INSTRUMENTATION=1"
+#endif
+
+using namespace vigra;
+
+struct FastFiltersInstrumentationTest
+{
+    void testPixelCounts()
+    {
+        const int width = 37, height = 53;
+        std::vector<float> kernel = { 0.3f, 0.2f, 0.1f, 0.05f, 0.025f, 0.02f, 0.015f, 0.01f,
+                                      0.008f, 0.006f, 0.004f, 0.002f };
+        std::vector<float> data(width * height), res(width * height);
+        for (int k = 0; k < width * height; ++k)
+            data[k] = (float)((k * 7919) % 23) - 11.0f;
+
+        // every pixel is counted exactly once, either as border or as body pixel,
+        // for unrolled and generic radii on all backends
+        SimdInstructionSet detected = fastfilters_cpu_detect();
+        for (int isa = SimdScalar; isa <= detected; ++isa)
+        {
+            fastfilters_set_instruction_set((SimdInstructionSet)isa);
+            for (int radius : { 2, 4, 11 })
+            {
+                fastfilters_reset_statistics();
+                for (int y = 0; y < height; ++y)
+                    AvxConvolveLine<KernelEven>::exec_x(&data[y * width], width, &res[y * width],
+                                                        &kernel[0], radius);
+                FastFiltersStatistics stats = fastfilters_statistics();
+                shouldEqual(stats.border_pixels + stats.body_pixels, (uint64_t)(width * height));
+
+                fastfilters_reset_statistics();
+                AvxConvolveLine<KernelOdd>::exec_y(&data[0], width, height, width, &res[0], width,
+                                                   &kernel[0], radius);
+                stats = fastfilters_statistics();
+                shouldEqual(stats.border_pixels + stats.body_pixels, (uint64_t)(width * height));
+
+                // in-place operation counts the same pixels
+                fastfilters_reset_statistics();
+                res = data;
+                AvxConvolveLine<KernelOdd>::exec_y(&res[0], width, height, width, &res[0], width,
+                                                   &kernel[0], radius);
+                stats = fastfilters_statistics();
+                shouldEqual(stats.border_pixels + stats.body_pixels, (uint64_t)(width * height));
+            }
+        }
+        fastfilters_set_instruction_set(detected);
+    }
+
+    void testScratchAllocations()
+    {
+        const int width = 37, height = 53, radius = 4;
+        std::vector<float> kernel = { 0.3f, 0.2f, 0.1f, 0.05f, 0.025f };
+        std::vector<float> data(width * height, 1.0f);
+
+        // in-place exec_y allocates the ring buffer of an empty workspace once
+        FastFiltersWorkspace workspace;
+        fastfilters_reset_statistics();
+        AvxConvolveLine<KernelEven>::exec_y(&data[0], width, height, width, &data[0], width,
+                                            &kernel[0], radius, workspace);
+        FastFiltersStatistics stats = fastfilters_statistics();
+        shouldEqual(stats.scratch_allocations, 1u);
+        std::size_t bytes = AvxConvolveLine<KernelEven>::workspace_size(width, radius) * sizeof(float);
+        shouldEqual(stats.scratch_bytes, (uint64_t)bytes);
+
+        // direct output needs no scratch memory
+        std::vector<float> res(width * height);
+        AvxConvolveLine<KernelEven>::exec_y(&data[0], width, height, width, &res[0], width,
+                                            &kernel[0], radius, workspace);
+        shouldEqual(fastfilters_statistics().scratch_allocations, 1u);
+
+        // once warmed up, the thread's workspace is reused without allocations
+        AvxConvolveLine<KernelEven>::exec_y(&data[0], width, height, width, &data[0], width,
+                                            &kernel[0], radius);
+        fastfilters_reset_statistics();
+        for (int k = 0; k < 3; ++k)
+            AvxConvolveLine<KernelEven>::exec_y(&data[0], width, height, width, &data[0], width,
+                                                &kernel[0], radius);
+        shouldEqual(fastfilters_statistics().scratch_allocations, 0u);
+        shouldEqual(fastfilters_statistics().scratch_bytes, 0u);
+    }
+};
+
+
+struct FastFiltersInstrumentationTestSuite
+: public test_suite
+{
+    FastFiltersInstrumentationTestSuite()
+    : test_suite("FastFiltersInstrumentationTestSuite")
+    {
+        add(testCase(&FastFiltersInstrumentationTest::testPixelCounts));
+        add(testCase(&FastFiltersInstrumentationTest::testScratchAllocations));
+    }
+};
+
+
+int main(int argc, char ** argv)
+{
+    FastFiltersInstrumentationTestSuite test;
+
+    int failed = test.run(vigra::testsToBeExecuted(argc, argv));
+
+    std::cout << test.report() << std::endl;
+
+    return (failed != 0);
+}
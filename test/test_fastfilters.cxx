@@ -39,9 +39,119 @@
 #include <cmath>
 #include <vigra2/unittest.hxx>
 #include <vigra2/fastfilters.hxx>
+#include <vigra2/fastfilters_gaussian.hxx>
+#include <vigra2/fastfilters_parallel.hxx>
+#include <vigra2/fastfilters_bank.hxx>
+#include <vigra2/fastfilters_iir.hxx>
+#include <vigra2/fastfilters_blockwise.hxx>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 
 using namespace vigra;
 
+// naive reference: reflective border treatment, kernel[-k] = +/-kernel[k]
+inline float referenceConvolve(std::vector<float> const & line, int x,
+                               std::vector<float> const & kernel, bool odd)
+{
+    int size = (int)line.size(), radius = (int)kernel.size() - 1;
+    float sum = kernel[0] * line[x];
+    for (int k = 1; k <= radius; ++k)
+    {
+        int left = std::abs(x - k),
+            right = x + k < size ? x + k : 2 * size - 2 - x - k;
+        sum += odd ? kernel[k] * (line[right] - line[left])
+                   : kernel[k] * (line[right] + line[left]);
+    }
+    return sum;
+}
+
+// Restores the instruction set and the unrolled radius on destruction, so
+// that a failed check does not leave later tests with restricted settings.
+struct FastFiltersSettingsGuard
+{
+    FastFiltersSettingsGuard()
+    : isa(fastfilters_instruction_set())
+    , unrolled_radius(fastfilters_unrolled_radius())
+    {}
+
+    ~FastFiltersSettingsGuard()
+    {
+        fastfilters_set_instruction_set(isa);
+        fastfilters_set_unrolled_radius(unrolled_radius);
+    }
+
+    SimdInstructionSet isa;
+    ArrayIndex unrolled_radius;
+};
+
+// call f(isa) with each instruction set supported by the CPU selected in turn
+template <class FUNCTOR>
+void forEachInstructionSet(FUNCTOR f)
+{
+    FastFiltersSettingsGuard guard;
+    SimdInstructionSet detected = fastfilters_cpu_detect();
+    for (int isa = SimdScalar; isa <= detected; ++isa)
+    {
+        fastfilters_set_instruction_set((SimdInstructionSet)isa);
+        f((SimdInstructionSet)isa);
+    }
+}
+
+// Unique temporary directory, removed together with the files created
+// through file() on destruction, even if a check fails.
+struct FastFiltersTemporaryDirectory
+{
+    FastFiltersTemporaryDirectory()
+    {
+#ifdef _WIN32
+        char tmp[MAX_PATH + 1];
+        DWORD length = GetTempPathA(MAX_PATH + 1, tmp);
+        for (int k = 0; length > 0 && k < 100 && path.empty(); ++k)
+        {
+            std::string name = std::string(tmp, length) + "vigra_fastfilters_" +
+                               std::to_string(GetCurrentProcessId()) + "_" + std::to_string(k);
+            if (CreateDirectoryA(name.c_str(), NULL))
+                path = name;
+        }
+#else
+        char const * tmp = std::getenv("TMPDIR");
+        std::string name = std::string(tmp && *tmp ? tmp : "/tmp") + "/vigra_fastfilters_XXXXXX";
+        if (mkdtemp(&name[0]))
+            path = name;
+#endif
+        if (path.empty())
+            throw std::runtime_error("FastFiltersTemporaryDirectory: cannot create a temporary directory.");
+    }
+
+    ~FastFiltersTemporaryDirectory()
+    {
+        for (std::string const & f : files)
+            std::remove(f.c_str());
+#ifdef _WIN32
+        RemoveDirectoryA(path.c_str());
+#else
+        rmdir(path.c_str());
+#endif
+    }
+
+    std::string file(char const * name)
+    {
+        files.push_back(path + "/" + name);
+        return files.back();
+    }
+
+    std::string path;
+    std::vector<std::string> files;
+};
+
 struct FastFiltersTest
 {
     void testXFilter()
@@ -94,6 +204,708 @@ struct FastFiltersTest
         }
     }
 
+
+    template <KernelSymmetry SYMMETRY>
+    void checkBackend(SimdInstructionSet isa)
+    {
+        should(fastfilters_set_instruction_set(isa) == isa);
+
+        std::vector<float> kernel = { 0.3f, 0.2f, 0.1f, 0.05f, 0.025f };
+        bool odd = SYMMETRY == KernelOdd;
+
+        // sizes chosen to exercise the unrolled, single vector and scalar loops
+        for (int size : { 9, 17, 31, 70, 133 })
+        {
+            std::vector<float> data(size), res(size);
+            for (int k = 0; k < size; ++k)
+                data[k] = (float)((k * 7919) % 23) - 11.0f;
+
+            AvxConvolveLine<SYMMETRY>::exec_x(&data[0], size, &res[0], &kernel[0], 4);
+            for (int x = 0; x < size; ++x)
+                shouldEqualTolerance(res[x], referenceConvolve(data, x, kernel, odd), 1e-4f);
+
+            // filter the same data as a column of width 'w' images
+            for (int width : { 1, 5, 16, 37 })
+            {
+                std::vector<float> plane(width * size), plane_res(width * size);
+                for (int y = 0; y < size; ++y)
+                    for (int x = 0; x < width; ++x)
+                        plane[y * width + x] = data[y] * (x + 1);
+
+                AvxConvolveLine<SYMMETRY>::exec_y(&plane[0], width, size, width,
+                                                  &plane_res[0], width, &kernel[0], 4);
+                for (int y = 0; y < size; ++y)
+                    for (int x = 0; x < width; ++x)
+                        shouldEqualTolerance(plane_res[y * width + x],
+                                             referenceConvolve(data, y, kernel, odd) * (x + 1),
+                                             1e-4f * (x + 1));
+            }
+        }
+    }
+
+    void testBackends()
+    {
+        SimdInstructionSet detected = fastfilters_cpu_detect();
+        std::cout << "fast filters: detected instruction set "
+                  << fastfilters_instruction_set_name(detected) << std::endl;
+
+        forEachInstructionSet([&](SimdInstructionSet isa)
+        {
+            checkBackend<KernelEven>(isa);
+            checkBackend<KernelOdd>(isa);
+        });
+    }
+
+    void testGaussianKernel()
+    {
+        for (double sigma : { 0.7, 1.5, 4.0 })
+        {
+            std::vector<float> smooth = fastfilters_gaussian_kernel(sigma, 0, fastfilters_gaussian_radius(sigma, 0)),
+                               deriv1 = fastfilters_gaussian_kernel(sigma, 1, fastfilters_gaussian_radius(sigma, 1)),
+                               deriv2 = fastfilters_gaussian_kernel(sigma, 2, fastfilters_gaussian_radius(sigma, 2));
+
+            double sum0 = smooth[0], sum2 = deriv2[0], moment1 = 0.0, moment2 = 0.0;
+            for (std::size_t k = 1; k < smooth.size(); ++k)
+                sum0 += 2.0 * smooth[k];
+            for (std::size_t k = 1; k < deriv1.size(); ++k)
+                moment1 += 2.0 * k * deriv1[k];
+            for (std::size_t k = 1; k < deriv2.size(); ++k)
+            {
+                sum2 += 2.0 * deriv2[k];
+                moment2 += 2.0 * k * k * deriv2[k];
+            }
+
+            shouldEqualTolerance(sum0, 1.0, 1e-6);
+            shouldEqual(deriv1[0], 0.0f);
+            shouldEqualTolerance(moment1, 1.0, 1e-6);
+            shouldEqualTolerance(sum2, 0.0, 1e-6);
+            shouldEqualTolerance(moment2, 2.0, 1e-5);
+        }
+    }
+
+    void testGaussianND()
+    {
+        Shape<3> shape{ 23, 17, 12 };
+        ArrayND<3, float> data(shape), res(shape), ref(shape);
+        ArrayIndex size = data.size();
+        for (ArrayIndex k = 0; k < size; ++k)
+            data.data()[k] = (float)((k * 7919) % 101) / 101.0f;
+
+        TinyArray<double, 3> sigma{ 1.5, 0.0, 2.0 };
+        TinyArray<int, 3> order{ 1, 0, 2 };
+        fastfilters_gaussian(data, res, sigma, order);
+
+        // naive separable reference
+        std::vector<double> tmp(data.data(), data.data() + size);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (sigma[axis] == 0.0)
+                continue;
+            ArrayIndex radius = fastfilters_gaussian_radius(sigma[axis], order[axis]);
+            std::vector<float> kernel = fastfilters_gaussian_kernel(sigma[axis], order[axis], radius);
+            ArrayIndex n = shape[axis], stride = data.strides()[axis];
+            std::vector<double> line(n), next(tmp);
+            for (ArrayIndex start = 0; start < size; ++start)
+            {
+                if ((start / stride) % n != 0)
+                    continue; // not the first element of a line along 'axis'
+                for (ArrayIndex i = 0; i < n; ++i)
+                    line[i] = tmp[start + i * stride];
+                for (ArrayIndex i = 0; i < n; ++i)
+                {
+                    double sum = kernel[0] * line[i];
+                    for (ArrayIndex k = 1; k <= radius; ++k)
+                    {
+                        double left = line[std::abs(i - k)],
+                               right = line[i + k < n ? i + k : 2 * n - 2 - i - k];
+                        sum += kernel[k] * (order[axis] % 2 ? right - left : right + left);
+                    }
+                    next[start + i * stride] = sum;
+                }
+            }
+            tmp.swap(next);
+        }
+        for (ArrayIndex k = 0; k < size; ++k)
+            shouldEqualTolerance(res.data()[k], tmp[k], 1e-5);
+
+        // in-place operation gives the same result
+        std::copy(data.data(), data.data() + size, ref.data());
+        fastfilters_gaussian(ref, ref, sigma, order);
+        for (ArrayIndex k = 0; k < size; ++k)
+            shouldEqual(ref.data()[k], res.data()[k]);
+
+        // first derivative of a ramp along axis 1
+        for (ArrayIndex k = 0; k < size; ++k)
+            data.data()[k] = 0.5f * (float)((k / data.strides()[1]) % shape[1]);
+        fastfilters_gaussian(data, res, TinyArray<double, 3>{ 1.0, 2.0, 1.0 }, TinyArray<int, 3>{ 0, 1, 0 });
+        for (ArrayIndex z = 0; z < shape[2]; ++z)
+            for (ArrayIndex y = 7; y < shape[1] - 7; ++y)
+                for (ArrayIndex x = 0; x < shape[0]; ++x)
+                    shouldEqualTolerance(res.data()[x + y * data.strides()[1] + z * data.strides()[2]], 0.5f, 1e-5f);
+    }
+
+    void testParallel()
+    {
+        const ArrayIndex width = 301, height = 157, radius = 5;
+        std::vector<float> kernel = fastfilters_gaussian_kernel(1.5, 1, radius);
+        std::vector<float> data(width * height), serial(width * height), res(width * height);
+        for (std::size_t k = 0; k < data.size(); ++k)
+            data[k] = (float)((k * 7919) % 101) / 101.0f;
+
+        for (int n_threads : { 1, 3, 8 })
+        {
+            WorkStealingThreadPool pool(n_threads);
+            shouldEqual(pool.size(), n_threads);
+
+            // all lines in x-direction
+            for (ArrayIndex y = 0; y < height; ++y)
+                AvxConvolveLine<KernelOdd>::exec_x(&data[y * width], width, &serial[y * width], &kernel[0], radius);
+            ParallelConvolveLine<KernelOdd>::exec_x(pool, &data[0], width, height, width,
+                                                    &res[0], width, &kernel[0], radius);
+            should(res == serial);
+
+            res = data;
+            ParallelConvolveLine<KernelOdd>::exec_x(pool, &res[0], width, height, width,
+                                                    &res[0], width, &kernel[0], radius);
+            should(res == serial);
+
+            // y-direction, wide plane (column blocks) and narrow plane (row slabs)
+            for (ArrayIndex w : { width, (ArrayIndex)13 })
+            {
+                AvxConvolveLine<KernelOdd>::exec_y(&data[0], w, height, width, &serial[0], width, &kernel[0], radius);
+                std::fill(res.begin(), res.end(), 0.0f);
+                ParallelConvolveLine<KernelOdd>::exec_y(pool, &data[0], w, height, width,
+                                                        &res[0], width, &kernel[0], radius);
+                for (ArrayIndex y = 0; y < height; ++y)
+                    for (ArrayIndex x = 0; x < w; ++x)
+                        shouldEqual(res[y * width + x], serial[y * width + x]);
+
+                res = data;
+                ParallelConvolveLine<KernelOdd>::exec_y(pool, &res[0], w, height, width,
+                                                        &res[0], width, &kernel[0], radius);
+                for (ArrayIndex y = 0; y < height; ++y)
+                    for (ArrayIndex x = 0; x < w; ++x)
+                        shouldEqual(res[y * width + x], serial[y * width + x]);
+            }
+
+            // N-D filter
+            Shape<3> shape{ 40, 33, 21 };
+            ArrayND<3, float> volume(shape), vserial(shape), vres(shape);
+            for (ArrayIndex k = 0; k < volume.size(); ++k)
+                volume.data()[k] = (float)((k * 7919) % 101) / 101.0f;
+            TinyArray<double, 3> sigma{ 1.0, 2.0, 3.0 };
+            TinyArray<int, 3> order{ 0, 1, 2 };
+            fastfilters_gaussian(volume, vserial, sigma, order);
+            fastfilters_gaussian(volume, vres, sigma, order, pool);
+            for (ArrayIndex k = 0; k < volume.size(); ++k)
+                shouldEqual(vres.data()[k], vserial.data()[k]);
+        }
+
+        // exceptions are passed to the caller
+        WorkStealingThreadPool pool(4);
+        bool caught = false;
+        try
+        {
+            pool.parallel_for(100, [](ArrayIndex i) { if (i == 42) throw std::runtime_error("task"); });
+        }
+        catch (std::runtime_error &)
+        {
+            caught = true;
+        }
+        should(caught);
+    }
+
+    void testFilterBank()
+    {
+        const ArrayIndex width = 97, height = 61;
+        std::vector<float> data(width * height);
+        for (std::size_t k = 0; k < data.size(); ++k)
+            data[k] = (float)((k * 7919) % 101) / 101.0f;
+
+        // 12 kernels of mixed symmetry and radius, processed in two chunks
+        FilterBank bank;
+        std::vector<std::vector<float>> kernels;
+        for (int j = 0; j < 12; ++j)
+        {
+            double sigma = 1.0 + 0.3 * j;
+            int order = j % 3;
+            kernels.push_back(fastfilters_gaussian_kernel(sigma, order, fastfilters_gaussian_radius(sigma, order)));
+            shouldEqual(bank.add(kernels.back(), order == 1 ? KernelOdd : KernelEven), j);
+        }
+        shouldEqual(bank.size(), 12);
+        shouldEqual(bank.radius(), (ArrayIndex)kernels.back().size() - 1);
+
+        std::vector<std::vector<float>> res(12, std::vector<float>(width * height));
+        std::vector<float *> out(12);
+        std::vector<float> ref(width * height);
+        for (int j = 0; j < 12; ++j)
+            out[j] = &res[j][0];
+
+        // all backends
+        forEachInstructionSet([&](SimdInstructionSet)
+        {
+            bank.exec_x(&data[0], width, &out[0]);
+            for (int j = 0; j < 12; ++j)
+            {
+                ArrayIndex radius = (ArrayIndex)kernels[j].size() - 1;
+                if (j % 3 == 1)
+                    AvxConvolveLine<KernelOdd>::exec_x(&data[0], width, &ref[0], &kernels[j][0], radius);
+                else
+                    AvxConvolveLine<KernelEven>::exec_x(&data[0], width, &ref[0], &kernels[j][0], radius);
+                for (ArrayIndex x = 0; x < width; ++x)
+                    shouldEqualTolerance(res[j][x], ref[x], 1e-5f);
+            }
+
+            bank.exec_y(&data[0], width, height, width, &out[0], width);
+            for (int j = 0; j < 12; ++j)
+            {
+                ArrayIndex radius = (ArrayIndex)kernels[j].size() - 1;
+                if (j % 3 == 1)
+                    AvxConvolveLine<KernelOdd>::exec_y(&data[0], width, height, width, &ref[0], width, &kernels[j][0], radius);
+                else
+                    AvxConvolveLine<KernelEven>::exec_y(&data[0], width, height, width, &ref[0], width, &kernels[j][0], radius);
+                for (ArrayIndex k = 0; k < width * height; ++k)
+                    shouldEqualTolerance(res[j][k], ref[k], 1e-5f);
+            }
+        });
+    }
+
+    void testFeatures()
+    {
+        Shape<2> shape{ 83, 57 };
+        ArrayND<2, float> data(shape), dx(shape), dy(shape), dxx(shape), dxy(shape), dyy(shape),
+                          res1(shape), res2(shape), res3(shape), par(shape);
+        for (ArrayIndex k = 0; k < data.size(); ++k)
+            data.data()[k] = (float)((k * 7919) % 101) / 101.0f;
+
+        double sigma = 1.7;
+        fastfilters_gaussian(data, dx,  TinyArray<double, 2>(sigma), TinyArray<int, 2>{ 1, 0 });
+        fastfilters_gaussian(data, dy,  TinyArray<double, 2>(sigma), TinyArray<int, 2>{ 0, 1 });
+        fastfilters_gaussian(data, dxx, TinyArray<double, 2>(sigma), TinyArray<int, 2>{ 2, 0 });
+        fastfilters_gaussian(data, dxy, TinyArray<double, 2>(sigma), TinyArray<int, 2>{ 1, 1 });
+        fastfilters_gaussian(data, dyy, TinyArray<double, 2>(sigma), TinyArray<int, 2>{ 0, 2 });
+
+        std::vector<ArrayViewND<2, float>> dest = { res1, res2, res3 };
+        std::vector<TinyArray<int, 2>> orders = { TinyArray<int, 2>{ 1, 0 }, TinyArray<int, 2>{ 1, 1 },
+                                                  TinyArray<int, 2>{ 0, 2 } };
+        fastfilters_gaussian_derivatives(data, dest, orders, sigma);
+        for (ArrayIndex k = 0; k < data.size(); ++k)
+        {
+            shouldEqualTolerance(res1.data()[k], dx.data()[k], 1e-5f);
+            shouldEqualTolerance(res2.data()[k], dxy.data()[k], 1e-5f);
+            shouldEqualTolerance(res3.data()[k], dyy.data()[k], 1e-5f);
+        }
+
+        WorkStealingThreadPool pool(3);
+
+        fastfilters_gradient_magnitude(data, res1, sigma);
+        fastfilters_gradient_magnitude(data, par, sigma, pool);
+        for (ArrayIndex k = 0; k < data.size(); ++k)
+        {
+            float x = dx.data()[k], y = dy.data()[k];
+            shouldEqualTolerance(res1.data()[k], std::sqrt(x * x + y * y), 1e-5f);
+            shouldEqual(par.data()[k], res1.data()[k]);
+        }
+
+        fastfilters_hessian_eigenvalues(data, res1, res2, sigma, pool);
+        for (ArrayIndex k = 0; k < data.size(); ++k)
+        {
+            float xx = dxx.data()[k], xy = dxy.data()[k], yy = dyy.data()[k];
+            // trace and determinant are preserved
+            shouldEqualTolerance(res1.data()[k] + res2.data()[k], xx + yy, 1e-5f);
+            shouldEqualTolerance(res1.data()[k] * res2.data()[k], xx * yy - xy * xy, 1e-5f);
+            should(res1.data()[k] >= res2.data()[k]);
+        }
+
+        double outer = 2.5;
+        fastfilters_structure_tensor(data, res1, res2, res3, sigma, outer, pool);
+        for (ArrayIndex k = 0; k < data.size(); ++k)
+            dxy.data()[k] = dx.data()[k] * dy.data()[k];
+        fastfilters_gaussian(dxy, dxy, outer);
+        for (ArrayIndex k = 0; k < data.size(); ++k)
+            shouldEqualTolerance(res2.data()[k], dxy.data()[k], 1e-5f);
+    }
+
+    void testRecursiveGaussian()
+    {
+        const ArrayIndex width = 203, height = 37;
+        std::vector<float> data(width * height), iir(width * height), fir(width * height),
+                           transposed(width * height), res(width * height);
+        for (std::size_t k = 0; k < data.size(); ++k)
+            data[k] = (float)((k * 7919) % 101) / 101.0f;
+        for (ArrayIndex y = 0; y < height; ++y)
+            for (ArrayIndex x = 0; x < width; ++x)
+                transposed[x * height + y] = data[y * width + x];
+
+        // constants are preserved, slopes are reproduced in the interior
+        std::vector<float> ramp(width);
+        for (ArrayIndex x = 0; x < width; ++x)
+            ramp[x] = 0.25f * x + 3.0f;
+        std::fill(res.begin(), res.end(), 2.0f);
+        AvxRecursiveGaussianLine::exec_x(&res[0], width, &res[0], 6.0, 0);
+        for (ArrayIndex x = 0; x < width; ++x)
+            shouldEqualTolerance(res[x], 2.0f, 1e-4f);
+
+        // ... also for large sigma, where 1 - sum(a) is tiny and float rounding used to change the gain
+        Shape<2> constant_shape{ 301, 257 };
+        ArrayND<2, float> constant(constant_shape), smoothed(constant_shape);
+        std::fill(constant.data(), constant.data() + constant.size(), 100.0f);
+        for (double sigma : { 50.0, 100.0 })
+        {
+            should(GaussianFilterOptions().use_iir(sigma));
+            fastfilters_gaussian(constant, smoothed, sigma, 0);
+            for (ArrayIndex k = 0; k < smoothed.size(); ++k)
+                shouldEqualTolerance(smoothed.data()[k], 100.0f, 1e-2f);
+        }
+
+        AvxRecursiveGaussianLine::exec_x(&ramp[0], width, &res[0], 6.0, 1);
+        for (ArrayIndex x = 40; x < width - 40; ++x)
+            shouldEqualTolerance(res[x], 0.25f, 1e-4f);
+
+        for (double sigma : { 1.0, 4.0, 10.0 })
+        {
+            for (int order = 0; order <= 2; ++order)
+            {
+                std::vector<float> reference;
+                forEachInstructionSet([&](SimdInstructionSet isa)
+                {
+                    // x- and y-direction agree, in-place works
+                    AvxRecursiveGaussianLine::exec_x(&data[0], width, height, width, &iir[0], width, sigma, order);
+                    res = transposed;
+                    AvxRecursiveGaussianLine::exec_y(&res[0], height, width, height, &res[0], height, sigma, order);
+                    for (ArrayIndex y = 0; y < height; ++y)
+                        for (ArrayIndex x = 0; x < width; ++x)
+                            shouldEqual(res[x * height + y], iir[y * width + x]);
+
+                    // all backends agree
+                    if (isa == SimdScalar)
+                        reference = iir;
+                    for (std::size_t k = 0; k < data.size(); ++k)
+                        shouldEqualTolerance(iir[k], reference[k], 1e-4f);
+                });
+
+                // documented accuracy relative to the FIR filter
+                std::vector<float> kernel = fastfilters_gaussian_kernel(sigma, order,
+                                                                        fastfilters_gaussian_radius(sigma, order, 4.0));
+                for (ArrayIndex y = 0; y < height; ++y)
+                {
+                    if (order == 1)
+                        AvxConvolveLine<KernelOdd>::exec_x(&data[y * width], width, &fir[y * width],
+                                                           &kernel[0], (ArrayIndex)kernel.size() - 1);
+                    else
+                        AvxConvolveLine<KernelEven>::exec_x(&data[y * width], width, &fir[y * width],
+                                                            &kernel[0], (ArrayIndex)kernel.size() - 1);
+                }
+                float tolerance = sigma < 2.0 ? 0.2f : sigma < 8.0 ? 0.02f : 0.01f;
+                for (std::size_t k = 0; k < data.size(); ++k)
+                    shouldEqualTolerance(iir[k], fir[k], tolerance);
+            }
+        }
+
+        // automatic selection in fastfilters_gaussian()
+        Shape<2> shape{ width, height };
+        ArrayND<2, float> image(shape), selected(shape), forced(shape), parallel(shape);
+        std::copy(data.begin(), data.end(), image.data());
+        TinyArray<double, 2> sigma{ 10.0, 2.0 };
+        TinyArray<int, 2> order{ 1, 0 };
+
+        fastfilters_gaussian(image, selected, sigma, order);
+        AvxRecursiveGaussianLine::exec_x(&data[0], width, height, width, &iir[0], width, 10.0, 1);
+        std::vector<float> kernel = fastfilters_gaussian_kernel(2.0, 0, fastfilters_gaussian_radius(2.0, 0));
+        AvxConvolveLine<KernelEven>::exec_y(&iir[0], width, height, width, &iir[0], width,
+                                            &kernel[0], (ArrayIndex)kernel.size() - 1);
+        for (ArrayIndex k = 0; k < image.size(); ++k)
+            shouldEqual(selected.data()[k], iir[k]);
+
+        fastfilters_gaussian(image, forced, sigma, order,
+                             GaussianFilterOptions().set_iir_threshold(std::numeric_limits<double>::infinity()));
+        bool differs = false;
+        for (ArrayIndex k = 0; k < image.size(); ++k)
+        {
+            shouldEqualTolerance(forced.data()[k], selected.data()[k], 0.01f);
+            differs = differs || forced.data()[k] != selected.data()[k];
+        }
+        should(differs);
+
+        WorkStealingThreadPool pool(3);
+        fastfilters_gaussian(image, parallel, TinyArray<double, 2>(12.0), TinyArray<int, 2>{ 2, 1 }, pool);
+        fastfilters_gaussian(image, selected, TinyArray<double, 2>(12.0), TinyArray<int, 2>{ 2, 1 });
+        for (ArrayIndex k = 0; k < image.size(); ++k)
+            shouldEqual(parallel.data()[k], selected.data()[k]);
+    }
+
+    void testWorkspace()
+    {
+        const int width = 37, height = 53, radius = 4;
+        std::vector<float> kernel = { 0.3f, 0.2f, 0.1f, 0.05f, 0.025f };
+        std::vector<float> data(width * height), direct(width * height), inplace;
+        for (int k = 0; k < width * height; ++k)
+            data[k] = (float)((k * 7919) % 23) - 11.0f;
+
+        // direct output and in-place operation give identical results on all backends
+        forEachInstructionSet([&](SimdInstructionSet)
+        {
+            FastFiltersWorkspace workspace(AvxConvolveLine<KernelOdd>::workspace_size(width, radius));
+            shouldEqual(workspace.allocations(), 1);
+
+            AvxConvolveLine<KernelOdd>::exec_y(&data[0], width, height, width, &direct[0], width,
+                                               &kernel[0], radius, workspace);
+            for (int k = 0; k < 3; ++k)
+            {
+                inplace = data;
+                AvxConvolveLine<KernelOdd>::exec_y(&inplace[0], width, height, width, &inplace[0], width,
+                                                   &kernel[0], radius, workspace);
+                should(inplace == direct);
+            }
+            shouldEqual(workspace.allocations(), 1);
+        });
+
+        // the thread's workspace is reused by subsequent calls
+        inplace = data;
+        AvxConvolveLine<KernelOdd>::exec_y(&inplace[0], width, height, width, &inplace[0], width,
+                                           &kernel[0], radius);
+        AvxRecursiveGaussianLine::exec_y(&inplace[0], width, height, width, &inplace[0], width, 2.0, 0);
+        AvxRecursiveGaussianLine::exec_x(&inplace[0], width, height, width, &inplace[0], width, 2.0, 0);
+        ArrayIndex allocations = fastfilters_thread_workspace().allocations();
+        for (int k = 0; k < 3; ++k)
+        {
+            AvxConvolveLine<KernelOdd>::exec_y(&inplace[0], width, height, width, &inplace[0], width,
+                                               &kernel[0], radius);
+            AvxRecursiveGaussianLine::exec_y(&inplace[0], width, height, width, &inplace[0], width, 2.0, 0);
+            AvxRecursiveGaussianLine::exec_x(&inplace[0], width, height, width, &inplace[0], width, 2.0, 0);
+        }
+        shouldEqual(fastfilters_thread_workspace().allocations(), allocations);
+
+        // partially overlapping input and output are rejected
+        bool caught = false;
+        try
+        {
+            AvxConvolveLine<KernelOdd>::exec_y(&data[0], width, height - 1, width, &data[width], width,
+                                               &kernel[0], radius);
+        }
+        catch (std::runtime_error &)
+        {
+            caught = true;
+        }
+        should(caught);
+    }
+
+    template <KernelSymmetry SYMMETRY>
+    void checkUnrolledRadius(std::vector<float> const & data, int width, int height, int radius)
+    {
+        std::vector<float> kernel(radius + 1);
+        for (int k = 0; k <= radius; ++k)
+            kernel[k] = 1.0f / (k + 2);
+
+        std::vector<float> generic_x(data.size()), generic_y(data.size()),
+                           unrolled_x(data.size()), unrolled_y(data.size());
+        std::vector<float> in = data;
+
+        fastfilters_set_unrolled_radius(0);
+        AvxConvolveLine<SYMMETRY>::exec_x(&in[0], width * height, &generic_x[0], &kernel[0], radius);
+        AvxConvolveLine<SYMMETRY>::exec_y(&in[0], width, height, width, &generic_y[0], width, &kernel[0], radius);
+
+        fastfilters_set_unrolled_radius(VIGRA_FASTFILTERS_MAX_UNROLLED_RADIUS);
+        AvxConvolveLine<SYMMETRY>::exec_x(&in[0], width * height, &unrolled_x[0], &kernel[0], radius);
+        AvxConvolveLine<SYMMETRY>::exec_y(&in[0], width, height, width, &unrolled_y[0], width, &kernel[0], radius);
+
+        // the SIMD code is identical, the compiler may contract the scalar
+        // border code into multiply-adds differently
+        for (std::size_t k = 0; k < data.size(); ++k)
+        {
+            shouldEqualTolerance(unrolled_x[k], generic_x[k], 1e-5f);
+            shouldEqualTolerance(unrolled_y[k], generic_y[k], 1e-5f);
+        }
+    }
+
+    void testUnrolledRadius()
+    {
+        {
+            FastFiltersSettingsGuard guard;
+            shouldEqual(fastfilters_set_unrolled_radius(1000), VIGRA_FASTFILTERS_MAX_UNROLLED_RADIUS);
+            shouldEqual(fastfilters_set_unrolled_radius(-1), 0);
+        }
+        shouldEqual(fastfilters_unrolled_radius(), VIGRA_FASTFILTERS_MAX_UNROLLED_RADIUS);
+
+        const int width = 45, height = 41;
+        std::vector<float> data(width * height);
+        for (int k = 0; k < width * height; ++k)
+            data[k] = (float)((k * 7919) % 23) - 11.0f;
+
+        // the specialized kernels agree with the generic one
+        forEachInstructionSet([&](SimdInstructionSet)
+        {
+            for (int radius = 1; radius <= VIGRA_FASTFILTERS_MAX_UNROLLED_RADIUS + 2; ++radius)
+            {
+                checkUnrolledRadius<KernelEven>(data, width, height, radius);
+                checkUnrolledRadius<KernelOdd>(data, width, height, radius);
+            }
+        });
+        shouldEqual(fastfilters_unrolled_radius(), VIGRA_FASTFILTERS_MAX_UNROLLED_RADIUS);
+    }
+
+    void testHalfConversion()
+    {
+        shouldEqual(fastfilters_float_to_half(1.0f).bits, 0x3c00);
+        shouldEqual(fastfilters_float_to_half(-2.0f).bits, 0xc000);
+        shouldEqual(fastfilters_float_to_half(0.1f).bits, 0x2e66);
+        shouldEqual(fastfilters_float_to_half(65504.0f).bits, 0x7bff);
+        shouldEqual(fastfilters_float_to_half(65520.0f).bits, 0x7c00);
+        shouldEqual(fastfilters_float_to_half(6e-8f).bits, 0x0001);
+        shouldEqual(fastfilters_float_to_half(1e-8f).bits, 0x0000);
+        shouldEqual(fastfilters_float_to_half(1.0f + 1.0f / 2048).bits, 0x3c00); // tie to even
+        shouldEqual(fastfilters_float_to_half(1.0f + 3.0f / 2048).bits, 0x3c02);
+        FastFiltersHalf nan = fastfilters_float_to_half(std::numeric_limits<float>::quiet_NaN());
+        should((nan.bits & 0x7c00) == 0x7c00 && (nan.bits & 0x3ff) != 0);
+
+        // all finite values survive the round trip
+        for (unsigned bits = 0; bits < 0x10000; ++bits)
+        {
+            FastFiltersHalf h = { (uint16_t)bits };
+            if ((bits & 0x7c00) == 0x7c00)
+                continue;
+            shouldEqual(fastfilters_float_to_half(fastfilters_half_to_float(h)).bits, h.bits);
+        }
+
+        shouldEqual(FastFiltersConvert<uint8_t>::from_float(-3.0f), 0);
+        shouldEqual(FastFiltersConvert<uint8_t>::from_float(2.5f), 2);
+        shouldEqual(FastFiltersConvert<uint8_t>::from_float(3.5f), 4);
+        shouldEqual(FastFiltersConvert<uint8_t>::from_float(1e10f), 255);
+        shouldEqual(FastFiltersConvert<uint8_t>::from_float(std::numeric_limits<float>::quiet_NaN()), 0);
+        shouldEqual(FastFiltersConvert<uint16_t>::from_float(70000.0f), 65535);
+    }
+
+    template <class OUT>
+    void checkPixelType(std::vector<uint8_t> const & data, int width, int height,
+                        std::vector<float> & kernel, float tolerance)
+    {
+        const int radius = (int)kernel.size() - 1;
+        std::vector<float> fdata(data.begin(), data.end()), fres_x(data.size()), fres_y(data.size());
+        std::vector<OUT> res_x(data.size()), res_y(data.size());
+
+        for (int y = 0; y < height; ++y)
+        {
+            AvxConvolveLine<KernelOdd>::exec_x(&fdata[y * width], width, &fres_x[y * width], &kernel[0], radius);
+            AvxConvolveLine<KernelOdd>::exec_x(&data[y * width], width, &res_x[y * width], &kernel[0], radius);
+        }
+        AvxConvolveLine<KernelOdd>::exec_y(&fdata[0], width, height, width, &fres_y[0], width, &kernel[0], radius);
+        AvxConvolveLine<KernelOdd>::exec_y(&data[0], width, height, width, &res_y[0], width, &kernel[0], radius);
+
+        for (std::size_t k = 0; k < data.size(); ++k)
+        {
+            shouldEqualTolerance(FastFiltersConvert<OUT>::to_float(res_x[k]),
+                                 FastFiltersConvert<OUT>::to_float(FastFiltersConvert<OUT>::from_float(fres_x[k])),
+                                 tolerance);
+            shouldEqualTolerance(FastFiltersConvert<OUT>::to_float(res_y[k]),
+                                 FastFiltersConvert<OUT>::to_float(FastFiltersConvert<OUT>::from_float(fres_y[k])),
+                                 tolerance);
+        }
+    }
+
+    void testPixelTypes()
+    {
+        const int width = 53, height = 37;
+        std::vector<uint8_t> data(width * height);
+        for (int k = 0; k < width * height; ++k)
+            data[k] = (uint8_t)((k * 7919) % 251);
+
+        // odd kernel with large gain: the results exceed the range of uint8 on both sides
+        std::vector<float> kernel = { 0.0f, 2.0f, 1.0f, 0.5f };
+
+        forEachInstructionSet([&](SimdInstructionSet)
+        {
+            // integer results may differ by one where the exact value is half-way
+            checkPixelType<float>(data, width, height, kernel, 1e-3f);
+            checkPixelType<uint8_t>(data, width, height, kernel, 1.0f);
+            checkPixelType<uint16_t>(data, width, height, kernel, 1.0f);
+            checkPixelType<FastFiltersHalf>(data, width, height, kernel, 0.5f);
+
+            // in-place operation on 8-bit data
+            std::vector<float> smooth = { 0.4f, 0.2f, 0.1f };
+            std::vector<uint8_t> direct(data.size()), inplace = data;
+            AvxConvolveLine<KernelEven>::exec_y(&data[0], width, height, width, &direct[0], width, &smooth[0], 2);
+            AvxConvolveLine<KernelEven>::exec_y(&inplace[0], width, height, width, &inplace[0], width, &smooth[0], 2);
+            should(inplace == direct);
+        });
+
+        // integer source of the N-D filter
+        Shape<2> shape{ width, height };
+        ArrayND<2, uint8_t> image(shape);
+        ArrayND<2, float> fimage(shape), res(shape), ref(shape);
+        std::copy(data.begin(), data.end(), image.data());
+        std::copy(data.begin(), data.end(), fimage.data());
+        for (double sigma : { 0.0, 1.5, 12.0 })
+        {
+            fastfilters_gaussian(fimage, ref, sigma, 0);
+            fastfilters_gaussian(image, res, sigma, 0);
+            for (ArrayIndex k = 0; k < res.size(); ++k)
+                shouldEqualTolerance(res.data()[k], ref.data()[k], 1e-3f);
+        }
+    }
+
+    void testBlockwise()
+    {
+        FastFiltersTemporaryDirectory tmp;
+        const std::string src_file = tmp.file("src.raw"), dest_file = tmp.file("dest.raw");
+        Shape<3> shape{ 45, 38, 27 }, chunks{ 16, 16, 8 }, blocks{ 20, 17, 11 };
+        TinyArray<double, 3> sigma{ 1.5, 2.0, 1.0 };
+        TinyArray<int, 3> order{ 1, 0, 2 };
+        WorkStealingThreadPool pool(3);
+
+        ArrayND<3, float> data(shape), ref(shape);
+        auto index = [&](ArrayIndex x, ArrayIndex y, ArrayIndex z)
+        {
+            return x * data.strides()[0] + y * data.strides()[1] + z * data.strides()[2];
+        };
+        auto check = [&](FastFiltersVolume<3, float> const & dest)
+        {
+            for (ArrayIndex z = 0; z < shape[2]; ++z)
+                for (ArrayIndex y = 0; y < shape[1]; ++y)
+                    for (ArrayIndex x = 0; x < shape[0]; ++x)
+                        shouldEqualTolerance(*dest.pointer(Shape<3>{ x, y, z }), ref.data()[index(x, y, z)], 1e-2);
+        };
+
+        {
+            // raw uint16 source, chunked float result
+            FastFiltersMappedFile in = FastFiltersMappedFile::create(src_file, FastFiltersVolume<3, uint16_t>::bytes(shape)),
+                                  out = FastFiltersMappedFile::create(dest_file, FastFiltersVolume<3, float>::bytes(shape, chunks));
+            FastFiltersVolume<3, uint16_t> src(in.data(), shape);
+            FastFiltersVolume<3, float> dest(out.data(), shape, chunks);
+            for (ArrayIndex z = 0; z < shape[2]; ++z)
+                for (ArrayIndex y = 0; y < shape[1]; ++y)
+                    for (ArrayIndex x = 0; x < shape[0]; ++x)
+                    {
+                        uint16_t v = (uint16_t)(((x + 45 * y + 1710 * z) * 7919) % 1009);
+                        *src.pointer(Shape<3>{ x, y, z }) = v;
+                        data.data()[index(x, y, z)] = v;
+                    }
+
+            fastfilters_gaussian(data, ref, sigma, order);
+            fastfilters_gaussian_blockwise(src, dest, sigma, order, blocks, pool);
+            check(dest);
+
+            // incremental update: radii (5, 6, 4) reach 2 x 1 x 2 blocks
+            for (ArrayIndex z = 13; z < 14; ++z)
+                for (ArrayIndex y = 5; y < 7; ++y)
+                    for (ArrayIndex x = 20; x < 23; ++x)
+                    {
+                        *src.pointer(Shape<3>{ x, y, z }) = 1000;
+                        data.data()[index(x, y, z)] = 1000.0f;
+                    }
+            std::vector<FastFiltersBox<3>> changed = { FastFiltersBox<3>{ Shape<3>{ 20, 5, 13 }, Shape<3>{ 23, 7, 14 } } };
+            fastfilters_gaussian(data, ref, sigma, order);
+            shouldEqual(fastfilters_gaussian_blockwise_update(src, dest, sigma, order, blocks, changed, pool), 4);
+            check(dest);
+        }
+
+        {
+            // the result was written back to the file
+            FastFiltersMappedFile out = FastFiltersMappedFile::open(dest_file);
+            std::size_t bytes = FastFiltersVolume<3, float>::bytes(shape, chunks);
+            shouldEqual(out.size(), bytes);
+            check(FastFiltersVolume<3, float>(out.data(), shape, chunks));
+        }
+    }
 };
 
 
@@ -105,6 +917,18 @@ struct FastFiltersTestSuite
     {
         add(testCase(&FastFiltersTest::testXFilter));
         add(testCase(&FastFiltersTest::testYFilter));
+        add(testCase(&FastFiltersTest::testBackends));
+        add(testCase(&FastFiltersTest::testGaussianKernel));
+        add(testCase(&FastFiltersTest::testGaussianND));
+        add(testCase(&FastFiltersTest::testParallel));
+        add(testCase(&FastFiltersTest::testFilterBank));
+        add(testCase(&FastFiltersTest::testFeatures));
+        add(testCase(&FastFiltersTest::testRecursiveGaussian));
+        add(testCase(&FastFiltersTest::testWorkspace));
+        add(testCase(&FastFiltersTest::testUnrolledRadius));
+        add(testCase(&FastFiltersTest::testHalfConversion));
+        add(testCase(&FastFiltersTest::testPixelTypes));
+        add(testCase(&FastFiltersTest::testBlockwise));
     }
 };
 